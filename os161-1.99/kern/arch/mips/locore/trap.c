@@ -28,6 +28,7 @@
  */
 
 #include <types.h>
+#include <kern/wait.h>
 #include <signal.h>
 #include <lib.h>
 #include <mips/specialreg.h>
@@ -41,6 +42,7 @@
 #include <syscall.h>
 #include <proc.h>
 #include <addrspace.h>
+#include <opt-A2.h>
 #include <opt-A3.h>
 
 /* in exception.S */
@@ -116,13 +118,8 @@ kill_curthread(vaddr_t epc, unsigned code, vaddr_t vaddr)
 #if OPT_A3
     (void)epc;
     (void)vaddr;
-    struct proc *p = curproc;
-    struct addrspace *as;
-    as_deactivate();
-    as = curproc_setas(NULL);
-    proc_remthread(curthread);
-    proc_destroy(p);
-    thread_exit();
+    /* the process dies as if it called _exit, but with SIG as the status */
+    proc_terminate(_MKWAIT_SIG(sig));
 #endif // OPT_A3
 }
 
@@ -203,6 +200,12 @@ mips_trap(struct trapframe *tf)
         }
         
         curthread->t_in_interrupt = old_in;
+#if OPT_A2
+        /* process being torn down? then don't go back to it */
+        if (!iskern) {
+            proc_checkexit();
+        }
+#endif // OPT_A2
         goto done2;
     }
     
@@ -323,6 +326,11 @@ mips_trap(struct trapframe *tf)
     panic("I can't handle this... I think I'll just die now...\n");
     
 done:
+#if OPT_A2
+    if (!iskern) {
+        proc_checkexit();
+    }
+#endif // OPT_A2
     /*
      * Turn interrupts off on the processor, without affecting the
      * stored interrupt state.
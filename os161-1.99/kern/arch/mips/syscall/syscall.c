@@ -31,6 +31,8 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/syscall.h>
+#include <endian.h>
+#include <copyinout.h>
 #include <lib.h>
 #include <mips/trapframe.h>
 #include <thread.h>
@@ -82,6 +84,13 @@ syscall(struct trapframe *tf)
 	int callno;
 	int32_t retval;
 	int err;
+#ifdef UW
+	uint64_t pos64;
+	off_t retoff;
+	uint32_t retval_hi, retval_lo;
+	uint32_t pos32[2];
+	int whence;
+#endif // UW
 
 	KASSERT(curthread != NULL);
 	KASSERT(curthread->t_curspl == 0);
@@ -109,13 +118,124 @@ syscall(struct trapframe *tf)
 		err = sys___time((userptr_t)tf->tf_a0,
 				 (userptr_t)tf->tf_a1);
 		break;
+
+	    case SYS_nanosleep:
+		err = sys_nanosleep((const_userptr_t)tf->tf_a0,
+				    (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_getrusage:
+		err = sys_getrusage(tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_futex_wait:
+		err = sys_futex_wait((userptr_t)tf->tf_a0, (int)tf->tf_a1);
+		break;
+
+	    case SYS_futex_wake:
+		err = sys_futex_wake((userptr_t)tf->tf_a0, (int)tf->tf_a1,
+				     &retval);
+		break;
 #ifdef UW
+	case SYS_open:
+	  err = sys_open((userptr_t)tf->tf_a0,
+			 (int)tf->tf_a1,
+			 (mode_t)tf->tf_a2,
+			 (int *)(&retval));
+	  break;
+	case SYS_read:
+	  err = sys_read((int)tf->tf_a0,
+			 (userptr_t)tf->tf_a1,
+			 (size_t)tf->tf_a2,
+			 (int *)(&retval));
+	  break;
 	case SYS_write:
 	  err = sys_write((int)tf->tf_a0,
 			  (userptr_t)tf->tf_a1,
 			  (int)tf->tf_a2,
 			  (int *)(&retval));
 	  break;
+	case SYS_readv:
+	  err = sys_readv((int)tf->tf_a0,
+			  (const_userptr_t)tf->tf_a1,
+			  (int)tf->tf_a2,
+			  (int *)(&retval));
+	  break;
+	case SYS_writev:
+	  err = sys_writev((int)tf->tf_a0,
+			   (const_userptr_t)tf->tf_a1,
+			   (int)tf->tf_a2,
+			   (int *)(&retval));
+	  break;
+	case SYS_pread:
+	case SYS_pwrite:
+	  /* the offset is on the stack, after the slot for a3 */
+	  err = copyin((const_userptr_t)(tf->tf_sp + 16), pos32,
+		       sizeof(pos32));
+	  if (err) {
+	    break;
+	  }
+	  join32to64(pos32[0], pos32[1], &pos64);
+	  if (callno == SYS_pread) {
+	    err = sys_pread((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+			    (size_t)tf->tf_a2, (off_t)pos64,
+			    (int *)(&retval));
+	  }
+	  else {
+	    err = sys_pwrite((int)tf->tf_a0, (userptr_t)tf->tf_a1,
+			     (size_t)tf->tf_a2, (off_t)pos64,
+			     (int *)(&retval));
+	  }
+	  break;
+	case SYS_lseek:
+	  /* the offset is in a2/a3 (aligned), whence on the stack */
+	  join32to64(tf->tf_a2, tf->tf_a3, &pos64);
+	  err = copyin((const_userptr_t)(tf->tf_sp + 16), &whence,
+		       sizeof(whence));
+	  if (err) {
+	    break;
+	  }
+	  err = sys_lseek((int)tf->tf_a0, (off_t)pos64, whence, &retoff);
+	  if (err == 0) {
+	    /* a 64-bit result goes back in v0/v1 */
+	    split64to32((uint64_t)retoff, &retval_hi, &retval_lo);
+	    retval = retval_hi;
+	    tf->tf_v1 = retval_lo;
+	  }
+	  break;
+	case SYS_close:
+	  err = sys_close((int)tf->tf_a0);
+	  break;
+	case SYS_fsync:
+	  err = sys_fsync((int)tf->tf_a0);
+	  break;
+	case SYS_dup2:
+	  err = sys_dup2((int)tf->tf_a0, (int)tf->tf_a1,
+			 (int *)(&retval));
+	  break;
+	case SYS_fstat:
+	  err = sys_fstat((int)tf->tf_a0, (userptr_t)tf->tf_a1);
+	  break;
+	case SYS_stat:
+	  err = sys_stat((userptr_t)tf->tf_a0, (userptr_t)tf->tf_a1);
+	  break;
+	case SYS_chdir:
+	  err = sys_chdir((userptr_t)tf->tf_a0);
+	  break;
+	case SYS_mkdir:
+	  err = sys_mkdir((userptr_t)tf->tf_a0, (mode_t)tf->tf_a1);
+	  break;
+	case SYS_rmdir:
+	  err = sys_rmdir((userptr_t)tf->tf_a0);
+	  break;
+	case SYS_remove:
+	  err = sys_remove((userptr_t)tf->tf_a0);
+	  break;
+	case SYS_ioring_enter:
+	  err = sys_ioring_enter((userptr_t)tf->tf_a0,
+				 (unsigned)tf->tf_a1,
+				 (int *)(&retval));
+	  break;
 	case SYS__exit:
 	  sys__exit((int)tf->tf_a0);
 	  /* sys__exit does not return, execution should not get here */
@@ -137,9 +257,33 @@ syscall(struct trapframe *tf)
     case SYS_fork:
         err = sys_fork(tf, (pid_t *)&retval);
         break;
+    case SYS_vfork:
+        err = sys_vfork(tf, (pid_t *)&retval);
+        break;
         case SYS_execv:
             err = sys_execv((char*)tf->tf_a0, (char**)tf->tf_a1);
             break;
+    case SYS_spawn:
+        err = sys_spawn((userptr_t)tf->tf_a0, (userptr_t)tf->tf_a1,
+                        tf->tf_a2, (pid_t *)&retval);
+        break;
+    case SYS___thread_create:
+        err = sys___thread_create((userptr_t)tf->tf_a0,
+                                  (userptr_t)tf->tf_a1,
+                                  (userptr_t)tf->tf_a2,
+                                  &retval);
+        break;
+    case SYS_thread_exit:
+        sys_thread_exit((int)tf->tf_a0);
+        /* sys_thread_exit does not return, execution should not get here */
+        panic("unexpected return from sys_thread_exit");
+    case SYS_thread_join:
+        err = sys_thread_join((int)tf->tf_a0, (userptr_t)tf->tf_a1);
+        break;
+    case SYS_thread_setaffinity:
+        err = sys_thread_setaffinity((uint32_t)tf->tf_a0,
+                                     (userptr_t)tf->tf_a1);
+        break;
 #endif // OPT_A2
 	default:
 	  kprintf("Unknown syscall %d\n", callno);
@@ -186,8 +330,9 @@ syscall(struct trapframe *tf)
  */
 #if OPT_A2
 void enter_forked_process(void *argc1, unsigned long argc2)
-{   (void)argc2;
+{
     //DEBUG(DB_EXEC, "start enter_forked_process\n");
+    curthread->t_utid = argc2; // same thread id as in the parent
     as_activate();
 
     struct trapframe stack = *((struct trapframe *)argc1);
@@ -27,12 +27,15 @@
  * SUCH DAMAGE.
  */
 
+#include <opt-A2.h>
 #include <opt-A3.h>
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
 #include <spl.h>
 #include <spinlock.h>
+#include <synch.h>
+#include <cpu.h>
 #include <proc.h>
 #include <current.h>
 #include <mips/tlb.h>
@@ -47,6 +50,23 @@
 /* under dumbvm, always have 48k of user stack */
 #define DUMBVM_STACKPAGES    12
 
+#if OPT_A2
+/*
+ * Thread stacks sit below the main stack, each with an unmapped guard
+ * page underneath it. Slot 0 is the main stack.
+ */
+#define DUMBVM_TSTACKTOP(slot) \
+    (USERSTACK - (slot) * (DUMBVM_STACKPAGES + 1) * PAGE_SIZE)
+
+/*
+ * One shootdown at a time, so no cpu ever has more than one of ours
+ * queued and nothing overflows into a TLBSHOOTDOWN_ALL (which could
+ * not tell us it was done).
+ */
+static struct lock *shootdown_lock;
+static struct semaphore *shootdown_sem;
+#endif // OPT_A2
+
 /*
  * Wrap rma_stealmem in a spinlock.
  */
@@ -67,6 +87,13 @@ void
 vm_bootstrap(void)
 {
     /* Do nothing. */
+#if OPT_A2
+    shootdown_lock = lock_create("shootdown");
+    shootdown_sem = sem_create("shootdown", 0);
+    if (shootdown_lock == NULL || shootdown_sem == NULL) {
+        panic("vm_bootstrap: out of memory\n");
+    }
+#endif // OPT_A2
 #if OPT_A3
     paddr_t lo, hi;
     coreMade = true;
@@ -176,17 +203,109 @@ free_kpages(vaddr_t addr)
 #endif // OPT_A3
 }
 
+#if OPT_A2
+/*
+ * Drop any TLB entries for NPAGES pages at VADDR on this cpu.
+ */
+static
+void
+dumbvm_tlbinvalidate(vaddr_t vaddr, unsigned npages)
+{
+    unsigned i;
+    int index, spl;
+
+    spl = splhigh();
+    for (i = 0; i < npages; i++) {
+        index = tlb_probe(vaddr + i * PAGE_SIZE, 0);
+        if (index >= 0) {
+            tlb_write(TLBHI_INVALID(index), TLBLO_INVALID(), index);
+        }
+    }
+    splx(spl);
+}
+
+/*
+ * Remove NPAGES pages at VADDR of AS from every TLB, and wait until
+ * they are gone. Only cpus whose TLB may hold entries for AS are
+ * asked; any other cpu flushes everything when it next activates AS.
+ * The caller must already have made vm_fault stop mapping the pages.
+ */
+static
+void
+dumbvm_shootdown(struct addrspace *as, vaddr_t vaddr, unsigned npages)
+{
+    struct tlbshootdown ts;
+    struct cpu *c;
+    unsigned i, n, sent;
+    bool match;
+    int spl;
+
+    ts.ts_addrspace = as;
+    ts.ts_vaddr = vaddr;
+    ts.ts_npages = npages;
+    ts.ts_done = shootdown_sem;
+
+    lock_acquire(shootdown_lock);
+
+    /* stay on this cpu while deciding who else to ask */
+    spl = splhigh();
+    dumbvm_tlbinvalidate(vaddr, npages);
+    sent = 0;
+    n = cpu_count();
+    for (i = 0; i < n; i++) {
+        c = cpu_get(i);
+        if (c == curcpu->c_self) {
+            continue;
+        }
+        spinlock_acquire(&c->c_ipi_lock);
+        match = c->c_tlbas == as;
+        spinlock_release(&c->c_ipi_lock);
+        if (match) {
+            ipi_tlbshootdown(c, &ts);
+            sent++;
+        }
+    }
+    splx(spl);
+
+    for (i = 0; i < sent; i++) {
+        P(shootdown_sem);
+    }
+    lock_release(shootdown_lock);
+}
+#endif // OPT_A2
+
 void
 vm_tlbshootdown_all(void)
 {
+#if OPT_A2
+    int i, spl;
+
+    spl = splhigh();
+    for (i=0; i<NUM_TLB; i++) {
+        tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+    }
+    splx(spl);
+#else
     panic("dumbvm tried to do tlb shootdown?!\n");
+#endif // OPT_A2
 }
 
 void
 vm_tlbshootdown(const struct tlbshootdown *ts)
 {
+#if OPT_A2
+    /*
+     * If we've switched spaces since, the TLB was flushed anyway.
+     * Called without the IPI lock, but only this cpu sets c_tlbas.
+     */
+    if (curcpu->c_tlbas == ts->ts_addrspace) {
+        dumbvm_tlbinvalidate(ts->ts_vaddr, ts->ts_npages);
+    }
+    V(ts->ts_done);
+#else
     (void)ts;
     panic("dumbvm tried to do tlb shootdown?!\n");
+#endif // OPT_A2
 }
 
 int
@@ -198,6 +317,9 @@ vm_fault(int faulttype, vaddr_t faultaddress)
     uint32_t ehi, elo;
     struct addrspace *as;
     int spl;
+#if OPT_A2
+    unsigned slot;
+#endif // OPT_A2
     
     faultaddress &= PAGE_FRAME;
     
@@ -259,6 +381,14 @@ vm_fault(int faulttype, vaddr_t faultaddress)
     stackbase = USERSTACK - DUMBVM_STACKPAGES * PAGE_SIZE;
     stacktop = USERSTACK;
     
+    /*
+     * Disable interrupts on this CPU while frobbing the TLB. Under
+     * OPT_A2 do it before looking anything up: thread stacks can go
+     * away, and a shootdown must not land between reading
+     * as_tstackpbase and writing the entry.
+     */
+    spl = splhigh();
+    
     if (faultaddress >= vbase1 && faultaddress < vtop1) {
         paddr = (faultaddress - vbase1) + as->as_pbase1;
 #if OPT_A3
@@ -272,15 +402,29 @@ vm_fault(int faulttype, vaddr_t faultaddress)
         paddr = (faultaddress - stackbase) + as->as_stackpbase;
     }
     else {
+#if OPT_A2
+        for (slot = 1; slot < AS_NTHREADSTACKS; slot++) {
+            stacktop = DUMBVM_TSTACKTOP(slot);
+            stackbase = stacktop - DUMBVM_STACKPAGES * PAGE_SIZE;
+            if (as->as_tstackpbase[slot] != 0 &&
+                faultaddress >= stackbase && faultaddress < stacktop) {
+                break;
+            }
+        }
+        if (slot == AS_NTHREADSTACKS) {
+            splx(spl);
+            return EFAULT;
+        }
+        paddr = (faultaddress - stackbase) + as->as_tstackpbase[slot];
+#else
+        splx(spl);
         return EFAULT;
+#endif // OPT_A2
     }
     
     /* make sure it's page-aligned */
     KASSERT((paddr & PAGE_FRAME) == paddr);
     
-    /* Disable interrupts on this CPU while frobbing the TLB. */
-    spl = splhigh();
-    
     for (i=0; i<NUM_TLB; i++) {
         tlb_read(&ehi, &elo, i);
         if (elo & TLBLO_VALID) {
@@ -326,6 +470,11 @@ as_create(void)
     as->as_pbase2 = 0;
     as->as_npages2 = 0;
     as->as_stackpbase = 0;
+#if OPT_A2
+    for (unsigned i = 0; i < AS_NTHREADSTACKS; i++) {
+        as->as_tstackpbase[i] = 0;
+    }
+#endif // OPT_A2
 #if OPT_A3
     as->as_loaded = false;
     as->as_readable = false;
@@ -339,6 +488,14 @@ as_create(void)
 void
 as_destroy(struct addrspace *as)
 {
+#if OPT_A2
+    /* no threads are left, so nothing can still be using these */
+    for (unsigned i = 1; i < AS_NTHREADSTACKS; i++) {
+        if (as->as_tstackpbase[i] != 0) {
+            free_kpages(as->as_tstackpbase[i]);
+        }
+    }
+#endif // OPT_A2
 #if OPT_A3
     free_kpages(as->as_pbase2);
     free_kpages(as->as_pbase1);
@@ -364,6 +521,13 @@ as_activate(void)
     /* Disable interrupts on this CPU while frobbing the TLB. */
     spl = splhigh();
     
+#if OPT_A2
+    /* tell shootdowns whose entries we may be holding from now on */
+    spinlock_acquire(&curcpu->c_ipi_lock);
+    curcpu->c_tlbas = as;
+    spinlock_release(&curcpu->c_ipi_lock);
+#endif // OPT_A2
+    
     for (i=0; i<NUM_TLB; i++) {
         tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
     }
@@ -515,6 +679,65 @@ as_copy(struct addrspace *old, struct addrspace **ret)
             (const void *)PADDR_TO_KVADDR(old->as_stackpbase),
             DUMBVM_STACKPAGES*PAGE_SIZE);
     
+#if OPT_A2
+    /* fork may be called from any thread, so bring all the stacks */
+    for (unsigned i = 1; i < AS_NTHREADSTACKS; i++) {
+        if (old->as_tstackpbase[i] == 0) {
+            continue;
+        }
+        new->as_tstackpbase[i] = getppages(DUMBVM_STACKPAGES);
+        if (new->as_tstackpbase[i] == 0) {
+            as_destroy(new);
+            return ENOMEM;
+        }
+        memmove((void *)PADDR_TO_KVADDR(new->as_tstackpbase[i]),
+                (const void *)PADDR_TO_KVADDR(old->as_tstackpbase[i]),
+                DUMBVM_STACKPAGES*PAGE_SIZE);
+    }
+#endif // OPT_A2
+    
     *ret = new;
     return 0;
 }
+
+#if OPT_A2
+int
+as_define_threadstack(struct addrspace *as, unsigned slot, vaddr_t *stackptr)
+{
+    KASSERT(slot > 0 && slot < AS_NTHREADSTACKS);
+    
+    if (as->as_tstackpbase[slot] == 0) {
+        as->as_tstackpbase[slot] = getppages(DUMBVM_STACKPAGES);
+        if (as->as_tstackpbase[slot] == 0) {
+            return ENOMEM;
+        }
+    }
+    as_zero_region(as->as_tstackpbase[slot], DUMBVM_STACKPAGES);
+    
+    *stackptr = DUMBVM_TSTACKTOP(slot);
+    return 0;
+}
+
+void
+as_remove_threadstack(struct addrspace *as, unsigned slot)
+{
+    paddr_t pbase;
+    
+    KASSERT(slot > 0 && slot < AS_NTHREADSTACKS);
+    
+    /*
+     * Stop vm_fault handing out the pages first. A cpu that already
+     * read the old value did so at splhigh, so its TLB write lands
+     * before it takes our shootdown.
+     */
+    pbase = as->as_tstackpbase[slot];
+    as->as_tstackpbase[slot] = 0;
+    if (pbase == 0) {
+        return;
+    }
+    
+    dumbvm_shootdown(as, DUMBVM_TSTACKTOP(slot) - DUMBVM_STACKPAGES * PAGE_SIZE,
+                     DUMBVM_STACKPAGES);
+    free_kpages(pbase);
+}
+#endif // OPT_A2
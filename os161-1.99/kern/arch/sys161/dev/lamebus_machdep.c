@@ -38,6 +38,7 @@
 #include <current.h>
 #include <synch.h>
 #include <mainbus.h>
+#include <prof.h>
 #include <sys161/bus.h>
 #include <lamebus/lamebus.h>
 #include "autoconf.h"
@@ -73,6 +74,32 @@ mips_timer_set(uint32_t count)
 		:: "r" (count));
 }
 
+/*
+ * Reprogram the on-chip timer; see mainbus.h.
+ */
+void
+mainbus_settimer(uint64_t nsecs)
+{
+	uint64_t cycles;
+
+	if (nsecs == 0) {
+		mips_timer_set(CPU_FREQUENCY / HZ);
+		return;
+	}
+
+	/* The timer can count to about 171 seconds at 25 MHz. */
+	if (nsecs >= (uint64_t)0xffffffff * 1000 / (CPU_FREQUENCY / 1000000)) {
+		cycles = 0xffffffff;
+	}
+	else {
+		cycles = nsecs * (CPU_FREQUENCY / 1000000) / 1000;
+		if (cycles == 0) {
+			cycles = 1;
+		}
+	}
+	mips_timer_set(cycles);
+}
+
 /*
  * LAMEbus data for the system. (We have only one LAMEbus per system.)
  * This does not need to be locked, because it's constant once
@@ -270,6 +297,8 @@ mainbus_interrupt(struct trapframe *tf)
 	else if (cause & MIPS_TIMER_BIT) {
 		/* Reset the timer (this clears the interrupt) */
 		mips_timer_set(CPU_FREQUENCY / HZ);
+		/* sample for the profiler, if it's on */
+		prof_sample(tf);
 		/* and call hardclock */
 		hardclock();
 	}
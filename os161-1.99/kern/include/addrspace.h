@@ -34,11 +34,20 @@
  * Address space structure and operations.
  */
 
+#include <opt-A2.h>
 #include <opt-A3.h>
 #include <vm.h>
 
 struct vnode;
 
+#if OPT_A2
+/*
+ * Most threads one user process can have. Each gets its own stack
+ * slot; slot 0 is the main stack.
+ */
+#define AS_NTHREADSTACKS 16
+#endif // OPT_A2
+
 
 /*
  * Address space - data structure associated with the virtual memory
@@ -55,6 +64,9 @@ struct addrspace {
     paddr_t as_pbase2;
     size_t as_npages2;
     paddr_t as_stackpbase;
+#if OPT_A2
+    paddr_t as_tstackpbase[AS_NTHREADSTACKS]; /* [0] unused; see above */
+#endif // OPT_A2
 #if OPT_A3
     bool as_loaded;
     bool as_readable;
@@ -97,6 +109,15 @@ struct addrspace {
  *    as_define_stack - set up the stack region in the address space.
  *                (Normally called *after* as_complete_load().) Hands
  *                back the initial stack pointer for the new process.
+ *
+ *    as_define_threadstack - set up the stack for user thread slot
+ *                SLOT (1 to AS_NTHREADSTACKS-1), reusing its pages if
+ *                they are already there. Hands back the initial stack
+ *                pointer.
+ *
+ *    as_remove_threadstack - free the stack of thread slot SLOT,
+ *                shooting its mappings out of every cpu's TLB first.
+ *                May sleep.
  */
 
 struct addrspace *as_create(void);
@@ -113,6 +134,11 @@ int               as_define_region(struct addrspace *as,
 int               as_prepare_load(struct addrspace *as);
 int               as_complete_load(struct addrspace *as);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
+#if OPT_A2
+int               as_define_threadstack(struct addrspace *as, unsigned slot,
+                                        vaddr_t *initstackptr);
+void              as_remove_threadstack(struct addrspace *as, unsigned slot);
+#endif // OPT_A2
 
 
 /*
@@ -0,0 +1,66 @@
+#ifndef _CALLOUT_H_
+#define _CALLOUT_H_
+
+/*
+ * Callouts: functions to be called at some time in the future.
+ *
+ * Each cpu has a hierarchical timing wheel, advanced from hardclock().
+ * A callout goes on the wheel of the cpu that schedules it and runs
+ * there, in interrupt context, at or shortly after its deadline.
+ * Deadlines are absolute times in nanoseconds as returned by
+ * gettime_ns(); they are rounded up to the next hardclock tick.
+ *
+ * Callout functions run in an interrupt handler and must not sleep.
+ *
+ * The caller owns the struct callout and must keep it alive until it
+ * has fired or callout_stop has returned.
+ */
+
+struct callwheel; /* Opaque; one per cpu */
+struct cpu;
+
+struct callout {
+	struct callout *co_next;	/* list links within a wheel slot */
+	struct callout **co_prevp;
+	uint64_t co_tick;		/* tick the callout is due on */
+	void (*co_func)(void *);	/* what to call */
+	void *co_arg;			/* and its argument */
+	struct callwheel *co_wheel;	/* wheel last scheduled on */
+	bool co_pending;		/* true while on the wheel */
+};
+
+/*
+ * Set up a callout to call FUNC(ARG). Does not schedule it.
+ */
+void callout_init(struct callout *co, void (*func)(void *), void *arg);
+
+/*
+ * Schedule a callout for the absolute time DEADLINE, in nanoseconds.
+ * If it was already scheduled, it is rescheduled.
+ */
+void callout_schedule(struct callout *co, uint64_t deadline);
+
+/*
+ * Cancel a callout. Returns true if it was pending and now won't run,
+ * false if it has already run (or was never scheduled). In the latter
+ * case, callout_stop waits for the function to finish if it is
+ * running right now on another cpu.
+ */
+bool callout_stop(struct callout *co);
+
+/*
+ * Per-cpu setup, from cpu_create, and the per-tick hook, from
+ * hardclock.
+ */
+void callout_cpu_init(struct cpu *c);
+void callout_hardclock(void);
+
+/*
+ * Latest time this cpu can sleep until without missing a callout
+ * (it may be earlier than any callout is due), or 0 if it has none.
+ * For tickless idle.
+ */
+uint64_t callout_nextdeadline(void);
+
+
+#endif /* _CALLOUT_H_ */
@@ -35,13 +35,15 @@
 /*
  * Time-related definitions.
  *
- * hardclock() is called on every CPU HZ times a second, possibly only
- * when the CPU is not idle, for scheduling.
+ * hardclock() is called on every CPU HZ times a second, for scheduling,
+ * except on idle CPUs, which skip ticks until their next callout.
  *
  * timerclock() is called on one CPU once a second to allow simple
- * timed operations. (This is a fairly simpleminded interface.)
+ * timed operations. (This is a fairly simpleminded interface; for
+ * anything else use callouts, in <callout.h>, which hardclock runs.)
  *
  * gettime() may be used to fetch the current time of day.
+ * gettime_ns() returns the same thing as a count of nanoseconds.
  * getinterval() computes the time from time1 to time2.
  *
  * XXX we have struct timespec now, let's use it.
@@ -56,12 +58,16 @@
 #define HZ  100
 #endif
 
+/* nanoseconds per hardclock */
+#define HARDCLOCK_NS  (1000000000 / HZ)
+
 void hardclock_bootstrap(void);
 
 void hardclock(void);
 void timerclock(void);
 
 void gettime(time_t *seconds, uint32_t *nanoseconds);
+uint64_t gettime_ns(void);
 
 void getinterval(time_t secs1, uint32_t nsecs,
                  time_t secs2, uint32_t nsecs2,
@@ -70,8 +76,12 @@ void getinterval(time_t secs1, uint32_t nsecs,
 /*
  * clocksleep() suspends execution for the requested number of seconds,
  * like userlevel sleep(3). (Don't confuse it with wchan_sleep.)
+ *
+ * thread_sleep_until() suspends execution until the time DEADLINE,
+ * in nanoseconds as from gettime_ns(). It has hardclock resolution.
  */
 void clocksleep(int seconds);
+void thread_sleep_until(uint64_t deadline);
 
 
 #endif /* _CLOCK_H_ */
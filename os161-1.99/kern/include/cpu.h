@@ -46,6 +46,9 @@
  * a pointer with a fixed address and a per-cpu mapping in the MMU.
  */
 
+/* Buckets in the per-cpu scheduling latency histogram. */
+#define CPU_SCHEDLAT_BUCKETS	32
+
 struct cpu {
 	/*
 	 * Fixed after allocation.
@@ -59,7 +62,14 @@ struct cpu {
 	 */
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
+	struct thread *c_leaving;	/* Switched out, to go to another cpu */
+	struct thread *c_idlethread;	/* Idles here when c_leaving can't */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
+	unsigned c_elidedticks;		/* Hardclocks skipped while idle */
+	unsigned c_elidedyields;	/* Hardclocks with no one to yield to */
+	struct callwheel *c_callwheel;	/* Callouts (has its own lock) */
+	/* Scheduling latencies seen here; bucket N counts 2^N..2^(N+1)-1 ns */
+	unsigned c_schedlat[CPU_SCHEDLAT_BUCKETS];
 
 	/*
 	 * Accessed by other cpus.
@@ -69,6 +79,14 @@ struct cpu {
 	struct threadlist c_runqueue;	/* Run queue for this cpu */
 	struct spinlock c_runqueue_lock;
 
+	/*
+	 * Dead threads kept for reuse by threads forked here. Filled by
+	 * the reaper, which may be on another cpu.
+	 * Protected by the thread cache lock.
+	 */
+	struct threadlist c_threadcache;
+	struct spinlock c_threadcache_lock;
+
 	/*
 	 * Accessed by other cpus.
 	 * Protected by the IPI lock.
@@ -86,6 +104,9 @@ struct cpu {
 	uint32_t c_ipi_pending;		/* One bit for each IPI number */
 	struct tlbshootdown c_shootdown[TLBSHOOTDOWN_MAX];
 	int c_numshootdown;
+	struct addrspace *c_tlbas;	/* Space the TLB may have entries for */
+	unsigned c_ipisent;		/* IPIs actually sent to this cpu */
+	unsigned c_ipicoalesced;	/* IPIs folded into one already due */
 	struct spinlock c_ipi_lock;
 };
 
@@ -105,6 +126,12 @@ struct cpu {
  * for the cpu.
  */
 struct cpu *cpu_create(unsigned hardware_number);
+
+/*
+ * The number of cpus, and cpu number N, for statistics and the like.
+ */
+unsigned cpu_count(void);
+struct cpu *cpu_get(unsigned n);
 void cpu_machdep_init(struct cpu *);
 /*ASMLINKAGE*/ void cpu_start_secondary(void);
 void cpu_hatch(unsigned software_number);
@@ -153,6 +180,10 @@ void cpu_halt(void);
  * ipi_broadcast sends an IPI to all CPUs except the current one.
  * ipi_tlbshootdown is like ipi_send but carries TLB shootdown data.
  *
+ * An IPI whose bit is still pending on the target is not sent again;
+ * the interrupt already on its way handles both. Such IPIs count as
+ * coalesced, as do wakeups that share one IPI (see wchan_wakeall).
+ *
  * interprocessor_interrupt is called on the target CPU when an IPI is
  * received.
  */
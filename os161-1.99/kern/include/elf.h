@@ -193,8 +193,53 @@ typedef struct {
 #define	PF_X		0x1	/* Segment is executable */
 
 
+/*
+ * Section header. There are Ehdr.e_shnum of these, Ehdr.e_shentsize
+ * bytes apart, at Ehdr.e_shoff. Loading doesn't need them; they are
+ * used to find the symbol table.
+ */
+typedef struct {
+	uint32_t	sh_name;      /* Name (index into shstrtab) */
+	uint32_t	sh_type;      /* Type of section */
+	uint32_t	sh_flags;     /* Flags */
+	uint32_t	sh_addr;      /* Address when loaded */
+	uint32_t	sh_offset;    /* Location of data within file */
+	uint32_t	sh_size;      /* Size of data */
+	uint32_t	sh_link;      /* Related section (for symtab: strtab) */
+	uint32_t	sh_info;      /* Extra information */
+	uint32_t	sh_addralign; /* Alignment */
+	uint32_t	sh_entsize;   /* Size of entries, for tables */
+} Elf32_Shdr;
+
+/* values for sh_type (some) */
+#define	SHT_NULL	0		/* Section header entry unused */
+#define	SHT_PROGBITS	1		/* Program data */
+#define	SHT_SYMTAB	2		/* Symbol table */
+#define	SHT_STRTAB	3		/* String table */
+
+/*
+ * Symbol table entry.
+ */
+typedef struct {
+	uint32_t	st_name;      /* Name (index into strtab) */
+	uint32_t	st_value;     /* Value (address) */
+	uint32_t	st_size;      /* Size of object */
+	unsigned char	st_info;      /* Type and binding */
+	unsigned char	st_other;     /* Ignore */
+	uint16_t	st_shndx;     /* Section it belongs to */
+} Elf32_Sym;
+
+/* symbol type, from st_info */
+#define	ELF32_ST_TYPE(info)	((info) & 0xf)
+#define	STT_NOTYPE	0		/* Unspecified */
+#define	STT_OBJECT	1		/* Data object */
+#define	STT_FUNC	2		/* Function */
+
+
 typedef Elf32_Ehdr Elf_Ehdr;
 typedef Elf32_Phdr Elf_Phdr;
+typedef Elf32_Shdr Elf_Shdr;
+typedef Elf32_Sym Elf_Sym;
 
 
 #endif /* _ELF_H_ */
@@ -0,0 +1,92 @@
+#ifndef _FILETABLE_H_
+#define _FILETABLE_H_
+
+/*
+ * Open files and file descriptor tables.
+ *
+ * An open file is what open() makes: a vnode, how it was opened, and
+ * the seek position. It is shared by every descriptor that refers to
+ * it (dup2'd descriptors, and the same descriptor in a forked child)
+ * and reference counted; the vnode is closed when the last reference
+ * goes. Its offset is under a sleep lock that is held across each
+ * read or write, so I/O through one open file from several threads
+ * or processes doesn't interleave half-updated positions.
+ *
+ * A descriptor table maps a process's descriptors to open files. All
+ * the process's threads share it. It is protected by a spinlock, and
+ * looking up a descriptor takes a reference to the open file, so a
+ * descriptor closed by another thread meanwhile can't pull the file
+ * out from under I/O that is in progress.
+ */
+
+#include <limits.h>
+#include <spinlock.h>
+
+struct vnode;
+struct lock;
+
+struct openfile {
+	struct vnode *of_vnode;
+	int of_accmode;			/* O_RDONLY, O_WRONLY, or O_RDWR */
+	bool of_append;			/* O_APPEND: writes go at the end */
+	bool of_seekable;		/* has an offset (not a device) */
+	struct lock *of_lock;		/* held across each I/O */
+	off_t of_offset;		/* seek position, under of_lock */
+	struct spinlock of_reflock;
+	unsigned of_refcount;		/* under of_reflock */
+};
+
+/*
+ * Open PATH as for open(); the new open file has one reference. Like
+ * vfs_open, may destroy PATH.
+ */
+int openfile_open(char *path, int flags, mode_t mode, struct openfile **ret);
+
+/* Add and drop references. Dropping the last one closes the file. */
+void openfile_incref(struct openfile *of);
+void openfile_decref(struct openfile *of);
+
+
+struct filetable {
+	struct spinlock ft_lock;
+	struct openfile *ft_files[OPEN_MAX];	/* NULL if not open */
+};
+
+/* Create an empty table, or one with the console on 0, 1 and 2. */
+struct filetable *filetable_create(void);
+int filetable_openconsole(struct filetable *ft);
+
+/* Copy a table, for fork: the copy shares the open files. */
+struct filetable *filetable_copy(struct filetable *ft);
+
+/* Close everything and free the table. */
+void filetable_destroy(struct filetable *ft);
+
+/*
+ * Look up FD, returning its open file with a reference added that
+ * the caller must drop. EBADF if FD isn't open.
+ */
+int filetable_get(struct filetable *ft, int fd, struct openfile **ret);
+
+/*
+ * Install OF on the lowest free descriptor, returned in *FD; the
+ * table takes over the caller's reference. EMFILE if none is free.
+ */
+int filetable_place(struct filetable *ft, struct openfile *of, int *fd);
+
+/*
+ * Install OF on descriptor FD, taking over the caller's reference.
+ * If FD was open, its old file is returned in *OLDRET for the caller
+ * to drop (outside the table lock); otherwise *OLDRET is NULL.
+ */
+int filetable_placeat(struct filetable *ft, struct openfile *of, int fd,
+		      struct openfile **oldret);
+
+/*
+ * Remove FD, returning its open file and the table's reference to it
+ * in *RET. EBADF if FD isn't open.
+ */
+int filetable_remove(struct filetable *ft, int fd, struct openfile **ret);
+
+
+#endif /* _FILETABLE_H_ */
@@ -0,0 +1,30 @@
+#ifndef _FUTEX_H_
+#define _FUTEX_H_
+
+/*
+ * Futexes: blocking on a word of user memory.
+ *
+ * futex_wait(addr, val) sleeps only if the word at ADDR still holds
+ * VAL, checked and slept on atomically with respect to futex_wake on
+ * the same word; futex_wake(addr, n) wakes up to N of the sleepers.
+ * User code keeps its lock state in the word itself and only calls in
+ * here when it actually has to wait or has a waiter to wake, so
+ * uncontended operations never enter the kernel.
+ *
+ * Waiters are keyed by (address space, virtual address) and kept in a
+ * hash table of wait channels.
+ */
+
+struct addrspace;
+
+/* Call once during system startup. */
+void futex_bootstrap(void);
+
+/*
+ * Wake every futex waiter in AS, so its threads can notice the
+ * process is being torn down.
+ */
+void futex_wakeall(struct addrspace *as);
+
+
+#endif /* _FUTEX_H_ */
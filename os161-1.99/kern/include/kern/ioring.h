@@ -0,0 +1,60 @@
+#ifndef _KERN_IORING_H_
+#define _KERN_IORING_H_
+
+/*
+ * Submission and completion rings for batched file I/O.
+ *
+ * A process queues operations on the submission ring and hands them
+ * to the kernel with ioring_enter, which carries out as many as it
+ * can in one trap and posts a completion for each on the completion
+ * ring. The rings live in the process's own memory; the kernel reads
+ * and writes them only during ioring_enter, so there is nothing to
+ * map and no ordering to worry about beyond the system call itself.
+ * Threads sharing one ring need to lock it themselves.
+ *
+ * Indexes are free-running and taken mod IORING_ENTRIES. The process
+ * advances ir_sqtail and ir_cqhead; the kernel advances ir_sqhead and
+ * ir_cqtail.
+ */
+
+/* Ring size. Must be a power of 2. */
+#define IORING_ENTRIES	64
+
+/* Operations */
+#define IORING_OP_NOP		0
+#define IORING_OP_READ		1	/* read(fd, buf, len) */
+#define IORING_OP_WRITE		2	/* write(fd, buf, len) */
+#define IORING_OP_PREAD		3	/* pread(fd, buf, len, off) */
+#define IORING_OP_PWRITE	4	/* pwrite(fd, buf, len, off) */
+#define IORING_OP_FSYNC		5	/* fsync(fd) */
+#define IORING_OP_CLOSE		6	/* close(fd) */
+
+struct ioring_sqe {
+	off_t sqe_off;			/* file offset, for PREAD/PWRITE */
+	int sqe_op;			/* IORING_OP_* */
+	int sqe_fd;
+#ifdef _KERNEL
+	userptr_t sqe_buf;
+#else
+	void *sqe_buf;
+#endif
+	size_t sqe_len;
+	unsigned sqe_data;		/* passed back in the completion */
+	unsigned sqe_pad;
+};
+
+struct ioring_cqe {
+	unsigned cqe_data;		/* sqe_data of the operation */
+	int cqe_res;			/* what the call returned, or -errno */
+};
+
+struct ioring {
+	unsigned ir_sqhead;		/* kernel: taken up to here */
+	unsigned ir_sqtail;		/* process: queued up to here */
+	unsigned ir_cqhead;		/* process: reaped up to here */
+	unsigned ir_cqtail;		/* kernel: completed up to here */
+	struct ioring_sqe ir_sq[IORING_ENTRIES];
+	struct ioring_cqe ir_cq[IORING_ENTRIES];
+};
+
+#endif /* _KERN_IORING_H_ */
@@ -35,5 +35,8 @@
 #define STDOUT_FILENO 1      /* Standard output */
 #define STDERR_FILENO 2      /* Standard error */
 
+/* Flags for spawn */
+#define SPAWN_STDIO   1      /* Child inherits only descriptors 0-2 */
+
 
 #endif /* _KERN_UNISTD_H_ */
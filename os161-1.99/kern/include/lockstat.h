@@ -0,0 +1,58 @@
+#ifndef _LOCKSTAT_H_
+#define _LOCKSTAT_H_
+
+/*
+ * Lock contention statistics.
+ *
+ * Only compiled in with "options lockstat". When on, every spinlock,
+ * sleep lock, semaphore P and cv_wait is counted against a slot:
+ * spinlocks by the call site of spinlock_acquire, the others by
+ * name, so all locks called "vfs_biglock" (say) share one slot.
+ *
+ * Per slot we keep the number of acquisitions, how many of those had
+ * to wait, total and maximum wait time, and (for spinlocks and locks)
+ * total and maximum hold time. Times are in nanoseconds as read from
+ * gettime(), whose clock on System/161 ticks once per cpu cycle.
+ *
+ * Collection starts off; lockstat_bootstrap turns it on once the
+ * clock is attached.
+ */
+
+#include "opt-lockstat.h"
+
+#if OPT_LOCKSTAT
+
+/* What sort of thing a slot counts. */
+#define LOCKSTAT_SPINLOCK	1
+#define LOCKSTAT_LOCK		2
+#define LOCKSTAT_SEM		3
+#define LOCKSTAT_CV		4
+
+/* Slot number meaning "not being counted". */
+#define LOCKSTAT_NOSLOT		(-1)
+
+extern volatile bool lockstat_enabled;
+
+/* Call once the clock is attached, to start collecting. */
+void lockstat_bootstrap(void);
+
+/* Current time in nanoseconds. */
+uint64_t lockstat_now(void);
+
+/* Find (or make) the slot for a named lock, or for a spinlock call site. */
+int lockstat_slot_byname(int kind, const char *name);
+int lockstat_slot_bysite(vaddr_t site);
+
+/* Record an acquisition that waited WAITNS (0 if uncontended). */
+void lockstat_acquired(int slot, bool contended, uint64_t waitns);
+
+/* Record a release after holding for HOLDNS. */
+void lockstat_released(int slot, uint64_t holdns);
+
+/* Print the MAX slots with the most total wait time, or reset. */
+void lockstat_print(unsigned max);
+void lockstat_reset(void);
+
+#endif /* OPT_LOCKSTAT */
+
+#endif /* _LOCKSTAT_H_ */
@@ -55,6 +55,14 @@ size_t mainbus_ramsize(void);
 /* Switch on an inter-processor interrupt. (Low-level.) */
 void mainbus_send_ipi(struct cpu *target);
 
+/*
+ * Make this cpu's next hardclock come NSECS from now (as near as the
+ * timer can manage), or pass 0 to go back to ticking HZ times a
+ * second. Each hardclock also goes back to ticking HZ times a second.
+ * Used for tickless idle. Interrupts should be off.
+ */
+void mainbus_settimer(uint64_t nsecs);
+
 /*
  * The various ways to shut down the system. (These are very low-level
  * and should generally not be called directly - md_poweroff, for
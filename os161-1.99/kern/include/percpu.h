@@ -0,0 +1,68 @@
+#ifndef _PERCPU_H_
+#define _PERCPU_H_
+
+/*
+ * Per-cpu counters: sets of event counters that are cheap to bump
+ * from anywhere, including interrupt handlers, and rarely read.
+ *
+ * Each cpu has its own row of the set's counters and only ever
+ * changes its own row, with interrupts off for the moment it takes,
+ * so no lock is needed. Rows are padded out to whole cache lines and
+ * the storage is line-aligned, so no two cpus' counters share a
+ * line and counting doesn't bounce lines between cpus. Reading sums
+ * the rows without stopping anyone, so a read taken while counting
+ * goes on is only a snapshot.
+ *
+ * Counters are 32 bits and wrap.
+ */
+
+/* Rows in each set; cpu_create insists on fewer cpus than this. */
+#define PCPU_MAXCPUS	32
+
+/* At least the cache line size. */
+#define PCPU_LINESIZE	64
+
+/* Length of a row of NUM counters, padded to whole cache lines. */
+#define PCPU_ROWLEN(num) \
+	((((num) * sizeof(unsigned) + PCPU_LINESIZE - 1) / PCPU_LINESIZE) * \
+	 (PCPU_LINESIZE / sizeof(unsigned)))
+
+struct pcpu_counters {
+	unsigned pc_num;		/* counters in the set */
+	unsigned pc_rowlen;		/* PCPU_ROWLEN(pc_num) */
+	unsigned *pc_counts;		/* [PCPU_MAXCPUS][pc_rowlen] */
+};
+
+/*
+ * For a statically allocated set of NUM counters, declare its storage
+ * NAME with PCPU_COUNTERS_STORAGE, e.g.:
+ *
+ *     static PCPU_COUNTERS_STORAGE(foo_storage, FOO_COUNT);
+ *     static struct pcpu_counters foo =
+ *         PCPU_COUNTERS_INITIALIZER(foo_storage, FOO_COUNT);
+ */
+#define PCPU_COUNTERS_STORAGE(name, num) \
+	unsigned name[PCPU_MAXCPUS * PCPU_ROWLEN(num)] \
+		__attribute__((__aligned__(PCPU_LINESIZE)))
+#define PCPU_COUNTERS_INITIALIZER(storage, num) \
+	{ (num), PCPU_ROWLEN(num), (storage) }
+
+/*
+ * Create and destroy a dynamically allocated set of NUM counters,
+ * all zero. pcpu_counters_create returns NULL if out of memory.
+ */
+struct pcpu_counters *pcpu_counters_create(unsigned num);
+void pcpu_counters_destroy(struct pcpu_counters *pc);
+
+/* Add 1, or N, to counter WHICH of the set. */
+void pcpu_counter_inc(struct pcpu_counters *pc, unsigned which);
+void pcpu_counter_add(struct pcpu_counters *pc, unsigned which, unsigned n);
+
+/* Total of counter WHICH over all cpus. */
+unsigned pcpu_counter_read(struct pcpu_counters *pc, unsigned which);
+
+/* Zero all the set's counters. Increments racing with it may be lost. */
+void pcpu_counters_zero(struct pcpu_counters *pc);
+
+
+#endif /* _PERCPU_H_ */
@@ -39,16 +39,73 @@
 #include "opt-A2.h"
 #include <spinlock.h>
 #include <thread.h> /* required for struct threadarray */
+#if OPT_A2
+#include <addrspace.h> /* for AS_NTHREADSTACKS */
+#endif // OPT_A2
 
 struct addrspace;
+struct rusage;
 struct vnode;
 #ifdef UW
 struct semaphore;
+struct filetable;
 #endif // UW
+#if OPT_A2
+struct rwlock;
+struct wchan;
+#endif // OPT_A2
 
 #if OPT_A2
-struct array *proctree;
-struct lock *proc_lock;
+/*
+ * The process table maps pids to procs. Each proc has a slot in the
+ * table, and its pid is the slot number plus a multiple of
+ * PROC_NSLOTS that is bumped each time the slot is reused, so pids
+ * aren't reused at once and finding a proc by pid is just an index
+ * and a compare.
+ *
+ * The slots are striped over PROC_NBUCKETS buckets (slot modulo
+ * PROC_NBUCKETS), each with its own spinlock and list of free slots,
+ * so procs coming and going on different cpus don't contend. A
+ * bucket's lock protects its slots; a proc can't be destroyed while
+ * it is in the table, so holding the lock also keeps the procs in
+ * its slots alive.
+ *
+ * Family links are protected by the procs' own p_lock:
+ *   - p_children, and each child's p_parent and sibling links, may
+ *     only change with both the parent's and the child's p_lock held.
+ *   - state and exitcode change with the proc's own p_lock held, and
+ *     its parent's too if it has one.
+ * Whoever finds an exited child under the child's p_lock, parent or
+ * (once orphaned) the child itself, is the one that destroys it.
+ *
+ * Lock order: a bucket lock (at most one), then a parent's p_lock,
+ * then its child's p_lock, then wait channels.
+ */
+#define PROC_NSLOTS 1024    /* most procs at once, plus unused slot 0 */
+#define PROC_NBUCKETS 16
+
+/* True if some proc has pid PID, right now. */
+bool proc_exists(pid_t pid);
+
+/* Copy the name of the proc with pid PID into BUF; false if none. */
+bool proc_getname(pid_t pid, char *buf, size_t len);
+
+/*
+ * User threads. A process's threads are numbered by their stack slot
+ * in the address space; the first thread is 0. A slot is FREE until a
+ * thread is created in it, and goes back to FREE when the thread's
+ * exit is collected by thread_join. EXITING threads are on their way
+ * out but may still be using the address space.
+ */
+#define UT_FREE     0
+#define UT_RUNNING  1
+#define UT_EXITING  2
+#define UT_EXITED   3
+
+struct uthread {
+    int ut_state;       /* UT_* */
+    int ut_exitcode;    /* once UT_EXITED */
+};
 #endif // OPT_A2
 
 /*
@@ -64,6 +121,13 @@ struct proc {
 
 	/* VFS */
 	struct vnode *p_cwd;		/* current working directory */
+	struct filetable *p_filetable;	/* open file descriptors */
+
+	/* Accounting totals of threads that have left (under p_lock) */
+	uint64_t p_runtime;		/* ns on cpu */
+	uint64_t p_waittime;		/* ns runnable, waiting for a cpu */
+	unsigned p_nvcsw;		/* voluntary switches */
+	unsigned p_nivcsw;		/* involuntary switches */
 
 #ifdef UW
   /* a vnode to refer to the console device */
@@ -76,11 +140,20 @@ struct proc {
 
 	/* add more material here as needed */
 #if OPT_A2
+    pid_t curpid;
+    /* under p_lock (see above): */
     int state;
     int exitcode;
-    pid_t curpid;
-    pid_t parent_pid;
-    struct cv *wait;
+    struct proc *p_parent;      /* NULL once orphaned */
+    struct proc *p_children;    /* list of children, via p_sibling */
+    struct proc *p_sibling;
+    struct proc **p_siblingprevp;
+    struct wchan *p_childwait;  /* woken when one of our children exits */
+    struct semaphore *p_vforksem; /* while running in our parent's address space */
+    /* under p_lock: */
+    struct uthread p_uthreads[AS_NTHREADSTACKS]; /* by user thread id */
+    bool p_exiting;         /* being torn down; other threads must go */
+    struct wchan *p_threadwait; /* woken when a user thread exits */
 #endif // OPT_A2
 };
 
@@ -113,9 +186,62 @@ struct addrspace *curproc_getas(void);
 /* Change the address space of the current process, and return the old one. */
 struct addrspace *curproc_setas(struct addrspace *);
 
+/* Sum the accounting of a process's threads, past and present. */
+void proc_getrusage(struct proc *proc, struct rusage *ru);
+
 #if OPT_A2
-int add_proctree(struct proc *p, struct proc *new);
-void proc_exit(struct proc *p, int exitcode);
+int add_proctree(struct proc *p, struct proc *parent);
+void proc_unlink(struct proc *child);
+void remove_proctree(struct proc *p);
+/* Destroy a new proc that never ran, taking it out of its family too. */
+void proc_discard(struct proc *p);
+/*
+ * If P is a vfork child, stop borrowing its parent's address space
+ * (which P must no longer be using) and let the parent go. Returns
+ * true if it was.
+ */
+bool proc_vforkdone(struct proc *p);
+/*
+ * Hand P, which has no threads left, to its parent to collect with
+ * wait status STATUS (as made by _MKWAIT_EXIT or _MKWAIT_SIG), or
+ * destroy it if it has no parent.
+ */
+void proc_exit(struct proc *p, int status);
+
+/*
+ * Make the current thread the only one in its process: tell the
+ * others to exit and wait until they have. Fails with EINTR if some
+ * other thread is already doing this, in which case the caller should
+ * leave with proc_threadleave. Unless EXITING, the process may have
+ * threads again afterwards; the caller keeps its thread id until it
+ * calls proc_becomemain.
+ */
+int proc_singlethread(bool exiting);
+
+/*
+ * Make the current thread, which must be the only one, thread 0 and
+ * free every other slot. For execv, once the new image has loaded.
+ */
+void proc_becomemain(void);
+
+/* Exit the current user thread, but not its process. Does not return. */
+void proc_threadleave(int exitcode);
+
+/*
+ * Exit the current process with wait status STATUS: stop its other
+ * threads, give up its address space and files, and hand it to
+ * proc_exit. Used by _exit and for fatal faults. Does not return.
+ */
+void proc_terminate(int status);
+
+/*
+ * Called on the way back to user mode: if the process is being torn
+ * down, exit this thread instead.
+ */
+void proc_checkexit(void);
+
+/* Print each process's threads with their accounting, for the menu. */
+void proc_printthreads(void);
 #endif // OPT_A2
 
 #endif /* _PROC_H_ */
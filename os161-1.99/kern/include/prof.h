@@ -0,0 +1,33 @@
+#ifndef _PROF_H_
+#define _PROF_H_
+
+/*
+ * Sampling profiler.
+ *
+ * While it is on, every timer interrupt records the interrupted pc,
+ * whether it was in user or kernel mode, and the process running,
+ * in a ring of samples per cpu. Once a ring is full the oldest
+ * samples are overwritten.
+ *
+ * prof_dump prints a flat histogram of kernel pcs, by function, and
+ * each process's split between user and kernel time. Functions are
+ * found from the symbol table of the kernel image at KERNELPATH
+ * (which should be the kernel that is running; the kernel doesn't
+ * keep its own symbols in memory). If it can't be read, raw pcs are
+ * shown instead.
+ */
+
+struct trapframe;
+
+/* Start (clearing any old samples) and stop sampling. */
+int prof_start(void);
+void prof_stop(void);
+
+/* Take a sample. Called from the timer interrupt. */
+void prof_sample(struct trapframe *tf);
+
+/* Print the top MAX functions and the per-process split. */
+void prof_dump(const char *kernelpath, unsigned max);
+
+
+#endif /* _PROF_H_ */
@@ -48,6 +48,9 @@ struct semaphore {
 	struct wchan *sem_wchan;
 	struct spinlock sem_lock;
         volatile int sem_count;
+#if OPT_LOCKSTAT
+        int sem_statslot;               /* lockstat slot, once known */
+#endif
 };
 
 struct semaphore *sem_create(const char *name, int initial_count);
@@ -81,6 +84,13 @@ struct lock {
         struct spinlock lk_lock;
         struct thread *lk_holder;
         volatile bool lk_state;
+        struct lock *lk_nextheld;       /* next in holder's t_heldlocks */
+        int lk_waitpri;                 /* highest priority donated by waiters */
+        unsigned lk_nwaiters;           /* threads in lock_acquire waiting */
+#if OPT_LOCKSTAT
+        int lk_statslot;                /* lockstat slot, once known */
+        uint64_t lk_stamp;              /* when acquired, if counted */
+#endif
 };
 
 struct lock *lock_create(const char *name);
@@ -96,10 +106,20 @@ void lock_acquire(struct lock *);
  *                   false otherwise.
  *
  * These operations must be atomic. You get to write them.
+ *
+ * Locks do priority inheritance: while a thread waits in lock_acquire,
+ * the holder (and, transitively, whatever the holder is waiting for)
+ * runs at no less than the waiter's priority. lock_release drops the
+ * donation and yields if that leaves a higher-priority thread ready.
+ *
+ *    lock_recompute_priority - Recompute the current thread's effective
+ *                   priority from its base priority and the waiters
+ *                   on the locks it holds. For thread_set_priority.
  */
 void lock_release(struct lock *);
 bool lock_do_i_hold(struct lock *);
 void lock_destroy(struct lock *);
+void lock_recompute_priority(void);
 
 
 /*
@@ -121,6 +141,9 @@ struct cv {
         struct wchan *cv_wchan;
         // add what you need here
         // (don't forget to mark things volatile as needed)
+#if OPT_LOCKSTAT
+        int cv_statslot;                /* lockstat slot, once known */
+#endif
 };
 
 struct cv *cv_create(const char *name);
@@ -144,4 +167,56 @@ void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
 
+/*
+ * Reader-writer lock.
+ *
+ * Any number of readers may hold the lock at once, or exactly one
+ * writer. Writers are preferred: once a writer is waiting, new
+ * readers block rather than starving it. To keep readers from being
+ * starved in turn, when a writer releases the lock the readers that
+ * were waiting are let in as a batch of at most RWLOCK_READ_BATCH
+ * before the next waiting writer gets its turn.
+ *
+ * The name field is for easier debugging. A copy of the name is
+ * made internally.
+ */
+#define RWLOCK_READ_BATCH 16
+
+struct rwlock {
+        char *rw_name;
+        struct wchan *rw_readwchan;	/* readers wait here */
+        struct wchan *rw_writewchan;	/* writers wait here */
+        struct spinlock rw_lock;
+        struct thread *rw_writer;	/* current writer, if any */
+        volatile unsigned rw_readers;	/* number of active readers */
+        volatile unsigned rw_waitreaders; /* number of blocked readers */
+        volatile unsigned rw_waitwriters; /* number of blocked writers */
+        volatile unsigned rw_batch;	/* readers still admitted ahead of
+                                           a waiting writer */
+};
+
+struct rwlock *rwlock_create(const char *name);
+void rwlock_destroy(struct rwlock *);
+
+/*
+ * Operations:
+ *    rwlock_acquire_read  - Get the lock for reading. Blocks while a
+ *                           writer holds the lock, or while a writer
+ *                           is waiting and the current read batch is
+ *                           used up.
+ *    rwlock_release_read  - Give up a read hold.
+ *    rwlock_acquire_write - Get the lock exclusively.
+ *    rwlock_release_write - Give up the exclusive hold. Only the
+ *                           thread holding the lock may do this.
+ *    rwlock_do_i_hold_write - Return true if the current thread holds
+ *                           the lock for writing. (Read holds are not
+ *                           tracked per thread.)
+ */
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+bool rwlock_do_i_hold_write(struct rwlock *);
+
+
 #endif /* _SYNCH_H_ */
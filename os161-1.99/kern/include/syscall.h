@@ -62,9 +62,30 @@ void enter_new_process(int argc, userptr_t argv, vaddr_t stackptr,
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_nanosleep(const_userptr_t req, userptr_t rem);
+int sys_getrusage(int who, userptr_t usage);
+int sys_futex_wait(userptr_t uaddr, int val);
+int sys_futex_wake(userptr_t uaddr, int count, int *retval);
 
 #ifdef UW
+int sys_open(userptr_t path, int flags, mode_t mode, int *retval);
+int sys_read(int fdesc, userptr_t ubuf, size_t nbytes, int *retval);
 int sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval);
+int sys_readv(int fdesc, const_userptr_t uiov, int iovcnt, int *retval);
+int sys_writev(int fdesc, const_userptr_t uiov, int iovcnt, int *retval);
+int sys_pread(int fdesc, userptr_t ubuf, size_t nbytes, off_t pos, int *retval);
+int sys_pwrite(int fdesc, userptr_t ubuf, size_t nbytes, off_t pos, int *retval);
+int sys_lseek(int fdesc, off_t pos, int whence, off_t *retval);
+int sys_close(int fdesc);
+int sys_fsync(int fdesc);
+int sys_dup2(int oldfd, int newfd, int *retval);
+int sys_fstat(int fdesc, userptr_t statbuf);
+int sys_stat(userptr_t path, userptr_t statbuf);
+int sys_chdir(userptr_t path);
+int sys_mkdir(userptr_t path, mode_t mode);
+int sys_rmdir(userptr_t path);
+int sys_remove(userptr_t path);
+int sys_ioring_enter(userptr_t ring, unsigned count, int *retval);
 void sys__exit(int exitcode);
 int sys_getpid(pid_t *retval);
 int sys_waitpid(pid_t pid, userptr_t status, int options, pid_t *retval);
@@ -73,7 +94,14 @@ int sys_waitpid(pid_t pid, userptr_t status, int options, pid_t *retval);
 #if OPT_A2
 // code you created or modified for ASST2 goes here
 int sys_fork(struct trapframe *tf, pid_t *retval);
+int sys_vfork(struct trapframe *tf, pid_t *retval);
 int sys_execv(char *program, char **args);
+int sys_spawn(userptr_t program, userptr_t args, int flags, pid_t *retval);
+int sys___thread_create(userptr_t entry, userptr_t arg0, userptr_t arg1,
+                        int *retval);
+void sys_thread_exit(int exitcode);
+int sys_thread_join(int tid, userptr_t status);
+int sys_thread_setaffinity(uint32_t mask, userptr_t oldmask);
 #endif // OPT_A2b
 
 #endif /* _SYSCALL_H_ */
@@ -41,6 +41,7 @@
 #include <threadlist.h>
 
 struct cpu;
+struct lock;
 
 /* get machine-dependent defs */
 #include <machine/thread.h>
@@ -56,6 +57,17 @@ struct cpu;
 #define SAME_STACK(p1, p2)     (((p1) & STACK_MASK) == ((p2) & STACK_MASK))
 
 
+/*
+ * Thread priorities. Threads with larger numbers run first; threads
+ * of equal priority run round-robin.
+ */
+#define THREAD_PRI_MIN		0
+#define THREAD_PRI_DEFAULT	16
+#define THREAD_PRI_MAX		31
+
+/* Names shorter than this are kept in the thread itself. */
+#define THREAD_NAMESIZE		32
+
 /* States a thread can be in. */
 typedef enum {
 	S_RUN,		/* running */
@@ -73,6 +85,7 @@ struct thread {
 	char *t_name;			/* Name of this thread */
 	const char *t_wchan_name;	/* Name of wait channel, if sleeping */
 	threadstate_t t_state;		/* State this thread is in */
+	char t_namebuf[THREAD_NAMESIZE]; /* t_name points here if it fits */
 
 	/*
 	 * Thread subsystem internal fields.
@@ -83,6 +96,8 @@ struct thread {
 	struct switchframe *t_context;	/* Saved register context (on stack) */
 	struct cpu *t_cpu;		/* CPU thread runs on */
 	struct proc *t_proc;		/* Process thread belongs to */
+	struct wchan *t_wchan;		/* Channel sleeping on (its lock) */
+	unsigned t_utid;		/* User thread id within t_proc */
 
 	/*
 	 * Interrupt state fields.
@@ -105,6 +120,37 @@ struct thread {
 	 * Public fields
 	 */
 
+	/*
+	 * Scheduling priority. t_basepri is what thread_set_priority
+	 * asked for; t_pri is the effective priority, which may be
+	 * raised above it by threads waiting for locks this thread
+	 * holds. See the priority inheritance notes in synch.c.
+	 */
+	int t_basepri;
+	struct spinlock t_pilock;	/* For t_pri and t_blockedon */
+	int t_pri;
+	struct lock *t_blockedon;	/* Lock we are waiting for, if any */
+	struct lock *t_heldlocks;	/* Locks we hold, via lk_nextheld */
+
+	/*
+	 * Cpus the thread may run on, one bit per c_number. Only the
+	 * thread itself changes it (thread_set_affinity); the scheduler
+	 * reads it when placing the thread on a run queue.
+	 */
+	uint32_t t_affinity;
+
+	/*
+	 * Accounting, stamped by thread_switch and thread_make_runnable
+	 * once thread_stats_bootstrap has run. Times are in ns. Only
+	 * the scheduler writes these; anyone else reading them for a
+	 * thread that is running elsewhere gets a slightly stale view.
+	 */
+	uint64_t t_stamp;		/* went on cpu, or became runnable */
+	uint64_t t_runtime;		/* time spent on cpu */
+	uint64_t t_waittime;		/* time spent runnable, waiting */
+	unsigned t_nvcsw;		/* switches from sleeping or yielding */
+	unsigned t_nivcsw;		/* switches from being preempted */
+
 	/* add more here as needed */
 };
 
@@ -121,6 +167,9 @@ DEFARRAY(thread, THREADINLINE);
 /* Call once during system startup to allocate data structures. */
 void thread_bootstrap(void);
 
+/* Call once the clock is attached, to start time accounting. */
+void thread_stats_bootstrap(void);
+
 /* Call late in system startup to get secondary CPUs running. */
 void thread_start_cpus(void);
 
@@ -144,6 +193,17 @@ int thread_fork(const char *name, struct proc *proc,
                 void (*func)(void *, unsigned long),
                 void *data1, unsigned long data2);
 
+/*
+ * Like thread_fork, but the new thread may only run on the cpus in
+ * AFFINITY (bit N for cpu N) instead of inheriting its creator's
+ * set. Fails with EINVAL if none of those cpus exist.
+ */
+#define THREAD_AFFINITY_ALL 0xffffffff
+int thread_fork_affinity(const char *name, struct proc *proc,
+                         uint32_t affinity,
+                         void (*func)(void *, unsigned long),
+                         void *data1, unsigned long data2);
+
 /*
  * Cause the current thread to exit.
  * Interrupts need not be disabled.
@@ -157,6 +217,26 @@ void thread_exit(void);
  */
 void thread_yield(void);
 
+/*
+ * Set the base priority of the current thread (THREAD_PRI_MIN to
+ * THREAD_PRI_MAX). New threads start with their creator's base
+ * priority. Yields if this leaves a higher-priority thread waiting.
+ */
+void thread_set_priority(int pri);
+
+/*
+ * Restrict the current thread to the cpus in MASK, moving it if it is
+ * on a cpu outside it (which takes up to one clock tick). Bits for
+ * cpus that don't exist are ignored; EINVAL if that leaves none.
+ */
+int thread_set_affinity(uint32_t mask);
+
+/*
+ * Tell the scheduler that the effective priority of T changed, so
+ * that if T is sitting on a run queue it is moved to the right place.
+ */
+void thread_reprioritize(struct thread *t);
+
 /*
  * Reshuffle the run queue. Called from the timer interrupt.
  */
@@ -168,5 +248,22 @@ void schedule(void);
  */
 void thread_consider_migration(void);
 
+/*
+ * Print what each cpu is running and what is on its run queue.
+ */
+void thread_print_runqueues(void);
+
+/*
+ * On-cpu time of thread T, in ns. For the current thread this
+ * includes the time since it last went on cpu.
+ */
+uint64_t thread_runtime(struct thread *t);
+
+/*
+ * Print each cpu's histogram of scheduling latency: the time from a
+ * thread becoming runnable to it going on cpu.
+ */
+void thread_print_schedlat(void);
+
 
 #endif /* _THREAD_H_ */
@@ -71,15 +71,29 @@ void wchan_unlock(struct wchan *wc);
  */
 void wchan_sleep(struct wchan *wc);
 
+/*
+ * Like wchan_sleep, but also wake up at time DEADLINE (nanoseconds,
+ * as from gettime_ns) if nobody else has. Returns 0 if woken by
+ * wchan_wake* and ETIMEDOUT if the deadline passed first.
+ */
+int wchan_sleep_until(struct wchan *wc, uint64_t deadline);
+
 /*
  * Wake up one thread, or all threads, sleeping on a wait channel.
  * The queue should not already be locked.
  *
- * The current implementation is FIFO but this is not promised by the
- * interface.
+ * wchan_wakeone picks the highest-priority sleeper, and among equals
+ * the one that has waited longest.
  */
 void wchan_wakeone(struct wchan *wc);
 void wchan_wakeall(struct wchan *wc);
 
+/*
+ * Return the highest effective priority among the threads sleeping
+ * on the channel, or -1 if there are none. The channel must be locked
+ * (and stays locked).
+ */
+int wchan_maxpri(struct wchan *wc);
+
 
 #endif /* _WCHAN_H_ */
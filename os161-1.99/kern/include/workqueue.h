@@ -0,0 +1,71 @@
+#ifndef _WORKQUEUE_H_
+#define _WORKQUEUE_H_
+
+/*
+ * Workqueues: functions to be called soon, in a kernel thread, rather
+ * than right now by the caller.
+ *
+ * A workqueue has a fixed pool of worker threads, at most one per
+ * cpu, each pinned to its cpu; the pool size bounds how many of the
+ * queue's work items run at once. Work is queued to the worker for
+ * the cpu it is queued from (or a worker shared with other cpus if
+ * the pool is smaller), and each worker runs its items in the order
+ * they were queued. A worker takes everything queued to it in one
+ * go, so a burst of work costs one wakeup.
+ *
+ * Unlike callouts, work functions run in thread context and may
+ * sleep. Work may be queued from interrupt handlers.
+ *
+ * The caller owns the struct work and must keep it alive until it
+ * has run. A work function may free or requeue its own struct work.
+ *
+ * Workqueues are never destroyed.
+ */
+
+#include <spinlock.h>
+
+struct workqueue;	/* Opaque */
+
+struct work {
+	struct work *w_next;		/* queue link */
+	void (*w_func)(void *);		/* what to call */
+	void *w_arg;			/* and its argument */
+	volatile spinlock_data_t w_pending; /* nonzero while queued */
+};
+
+/*
+ * The general-purpose workqueue, with a worker on every cpu.
+ */
+extern struct workqueue *system_wq;
+
+/*
+ * Create the system workqueue. Call once all cpus are running.
+ */
+void workqueue_bootstrap(void);
+
+/*
+ * Create a workqueue with NWORKERS worker threads, or one per cpu if
+ * NWORKERS is 0 or more than there are cpus. NAME is used for the
+ * threads. Returns NULL if out of memory.
+ */
+struct workqueue *workqueue_create(const char *name, unsigned nworkers);
+
+/*
+ * Set up a work item to call FUNC(ARG). Does not queue it.
+ */
+void work_init(struct work *w, void (*func)(void *), void *arg);
+
+/*
+ * Queue W on WQ. Returns false, and does nothing, if it is already
+ * queued and has not started running yet.
+ */
+bool work_enqueue(struct workqueue *wq, struct work *w);
+
+/*
+ * Wait until everything queued on WQ before the call has finished
+ * running. Must not be called from one of WQ's own work functions.
+ */
+void work_flush(struct workqueue *wq);
+
+
+#endif /* _WORKQUEUE_H_ */
@@ -45,12 +45,20 @@
 
 #include "opt-A2.h"
 #include <types.h>
+#include <kern/errno.h>
+#include <kern/time.h>
+#include <kern/resource.h>
+#include <kern/limits.h>
 #include <proc.h>
+#include <cpu.h>
 #include <current.h>
 #include <addrspace.h>
 #include <vnode.h>
 #include <vfs.h>
 #include <synch.h>
+#include <wchan.h>
+#include <futex.h>
+#include <filetable.h>
 #include <kern/fcntl.h>
 #include <kern/wait.h>
 
@@ -73,83 +81,470 @@ struct semaphore *no_proc_sem;
 #endif  // UW
 
 #if OPT_A2
-int count = 0;
-int arraysize = 32;
-// initillization the proctree, add new to p
-int add_proctree(struct proc *p, struct proc *new){
-    KASSERT(proc_lock != NULL);
-    KASSERT(p != NULL);
-    //DEBUG(DB_EXEC, "start add_proctree\n");
-    int change = 0; // record error
-    if(count+1 == arraysize){ // if the array overflow, multiple the size by 2
-        arraysize *= arraysize;
-        array_setsize(proctree, arraysize);
+/*
+ * The process table; see <proc.h>. Each bucket keeps a stack of its
+ * free slots, and proc_slotgen counts how many times each slot has
+ * been reused.
+ */
+struct proc_bucket {
+    struct spinlock pb_lock;
+    unsigned pb_nfree;
+    unsigned pb_free[PROC_NSLOTS / PROC_NBUCKETS];
+};
+
+static struct proc_bucket proc_buckets[PROC_NBUCKETS];
+static struct proc *proc_table[PROC_NSLOTS];
+static unsigned proc_slotgen[PROC_NSLOTS];
+/* where the next proc looks for a slot first; races are harmless */
+static volatile unsigned proc_nextbucket = 1;
+
+#define PROC_SLOT(pid) ((unsigned)(pid) % PROC_NSLOTS)
+#define PROC_BUCKET(slot) (&proc_buckets[(slot) % PROC_NBUCKETS])
+
+/* pid = slot + gen * PROC_NSLOTS must not exceed PID_MAX */
+#define PROC_NGENS (__PID_MAX / PROC_NSLOTS + 1)
+
+static void proctable_init(void){
+    struct proc_bucket *pb;
+
+    for(unsigned b = 0; b < PROC_NBUCKETS; b++){
+        spinlock_init(&proc_buckets[b].pb_lock);
+        proc_buckets[b].pb_nfree = 0;
     }
-    
-    for(int i = 1; i < arraysize; i++){
-        if(array_get(proctree, i) == NULL){
-            p->curpid = i;
-            array_set(proctree, i, p);
+    /* lowest slots on top; slot 0 is never used */
+    for(unsigned slot = PROC_NSLOTS; slot-- > 1; ){
+        pb = PROC_BUCKET(slot);
+        pb->pb_free[pb->pb_nfree++] = slot;
+    }
+}
+
+/* The proc with pid PID, or NULL. Its bucket lock must be held. */
+static struct proc *proc_lookup(pid_t pid){
+    struct proc *p;
+
+    KASSERT(pid > 0);
+    KASSERT(spinlock_do_i_hold(&PROC_BUCKET(PROC_SLOT(pid))->pb_lock));
+    p = proc_table[PROC_SLOT(pid)];
+    return (p != NULL && p->curpid == pid) ? p : NULL;
+}
+
+bool proc_exists(pid_t pid){
+    struct proc_bucket *pb;
+    bool ret;
+
+    if(pid <= 0){
+        return false;
+    }
+    pb = PROC_BUCKET(PROC_SLOT(pid));
+    spinlock_acquire(&pb->pb_lock);
+    ret = proc_lookup(pid) != NULL;
+    spinlock_release(&pb->pb_lock);
+    return ret;
+}
+
+bool proc_getname(pid_t pid, char *buf, size_t len){
+    struct proc_bucket *pb;
+    struct proc *p;
+
+    if(pid <= 0){
+        return false;
+    }
+    pb = PROC_BUCKET(PROC_SLOT(pid));
+    spinlock_acquire(&pb->pb_lock);
+    p = proc_lookup(pid);
+    if(p != NULL){
+        snprintf(buf, len, "%s", p->p_name);
+    }
+    spinlock_release(&pb->pb_lock);
+    return p != NULL;
+}
+
+/*
+ * Give P a pid and, if PARENT isn't NULL, make it PARENT's child.
+ */
+int add_proctree(struct proc *p, struct proc *parent){
+    struct proc_bucket *pb;
+    unsigned start, slot, b;
+
+    KASSERT(p != NULL);
+
+    p->state = 1;
+    p->p_parent = NULL;
+    p->p_children = NULL;
+    p->p_sibling = NULL;
+    p->p_siblingprevp = NULL;
+
+    /* try buckets in turn, starting from a different one each time */
+    start = proc_nextbucket++;
+    for(b = 0; b < PROC_NBUCKETS; b++){
+        pb = &proc_buckets[(start + b) % PROC_NBUCKETS];
+        spinlock_acquire(&pb->pb_lock);
+        if(pb->pb_nfree > 0){
+            slot = pb->pb_free[--pb->pb_nfree];
+            KASSERT(proc_table[slot] == NULL);
+            p->curpid = slot + proc_slotgen[slot] * PROC_NSLOTS;
+            proc_table[slot] = p;
+            spinlock_release(&pb->pb_lock);
             break;
         }
+        spinlock_release(&pb->pb_lock);
     }
-    
-    // error pid for p
-    if(p->curpid == -1){
-        change = -1;
-    }
-    // add no parent new for p
-    //DEBUG(DB_EXEC, "start add_proctree\n");
-    if(new == NULL){
-        p->parent_pid = -1;
-    } else {
-        p->parent_pid = new->curpid;
+    if(b == PROC_NBUCKETS){
+        return ENPROC;
     }
-    p->state = 1;
-    count++;
-    //DEBUG(DB_EXEC, "finish add_proctree\n");
-    return change;
+
+    if(parent != NULL){
+        spinlock_acquire(&parent->p_lock);
+        spinlock_acquire(&p->p_lock);
+        p->p_parent = parent;
+        p->p_sibling = parent->p_children;
+        if(p->p_sibling != NULL){
+            p->p_sibling->p_siblingprevp = &p->p_sibling;
+        }
+        p->p_siblingprevp = &parent->p_children;
+        parent->p_children = p;
+        spinlock_release(&p->p_lock);
+        spinlock_release(&parent->p_lock);
+    }
+    return 0;
+}
+
+/*
+ * Take CHILD off its parent's list of children. Both their p_locks
+ * must be held.
+ */
+void proc_unlink(struct proc *child){
+    KASSERT(child->p_parent != NULL);
+    KASSERT(spinlock_do_i_hold(&child->p_parent->p_lock));
+    KASSERT(spinlock_do_i_hold(&child->p_lock));
+
+    *child->p_siblingprevp = child->p_sibling;
+    if(child->p_sibling != NULL){
+        child->p_sibling->p_siblingprevp = child->p_siblingprevp;
+    }
+    child->p_sibling = NULL;
+    child->p_siblingprevp = NULL;
+    child->p_parent = NULL;
+}
+
+/*
+ * Take P, which must have no family left, out of the table, freeing
+ * its pid.
+ */
+void remove_proctree(struct proc *p){
+    unsigned slot = PROC_SLOT(p->curpid);
+    struct proc_bucket *pb = PROC_BUCKET(slot);
+
+    KASSERT(p->p_parent == NULL);
+    KASSERT(p->p_children == NULL);
+
+    spinlock_acquire(&pb->pb_lock);
+    KASSERT(proc_table[slot] == p);
+    proc_table[slot] = NULL;
+    proc_slotgen[slot] = (proc_slotgen[slot] + 1) % PROC_NGENS;
+    pb->pb_free[pb->pb_nfree++] = slot;
+    spinlock_release(&pb->pb_lock);
+}
+
+void proc_discard(struct proc *p){
+    struct proc *parent = p->p_parent;
+
+    KASSERT(threadarray_num(&p->p_threads) == 0);
+    if(parent != NULL){
+        /* nothing else knows about p, so the parent can't be going */
+        spinlock_acquire(&parent->p_lock);
+        spinlock_acquire(&p->p_lock);
+        proc_unlink(p);
+        spinlock_release(&p->p_lock);
+        spinlock_release(&parent->p_lock);
+    }
+    remove_proctree(p);
+    proc_destroy(p);
+}
+
+bool proc_vforkdone(struct proc *p){
+    struct semaphore *sem = p->p_vforksem;
+
+    if(sem == NULL){
+        return false;
+    }
+    p->p_vforksem = NULL;
+    /* the parent may destroy the address space as soon as this is done */
+    V(sem);
+    return true;
 }
 
-void proc_exit(struct proc *p, int exitcode){
+void proc_exit(struct proc *p, int status){
+    struct proc_bucket *pb;
+    struct proc *child, *zombies = NULL, *parent;
+    pid_t ppid;
+    bool done = false;
+
     KASSERT(p != NULL);
     KASSERT(p->curpid > 0);
     
-    p->state = 0; // exit code
-    p->exitcode = _MKWAIT_EXIT(exitcode);
-    int exit_pid = p->curpid;
+    /* nobody will wait for our children now: orphan or collect them */
+    spinlock_acquire(&p->p_lock);
+    while((child = p->p_children) != NULL){
+        spinlock_acquire(&child->p_lock);
+        proc_unlink(child);
+        if(child->state == 0){
+            /* the link is free now; use it for our own list */
+            child->p_sibling = zombies;
+            zombies = child;
+        }
+        spinlock_release(&child->p_lock);
+    }
+    spinlock_release(&p->p_lock);
+    while((child = zombies) != NULL){
+        zombies = child->p_sibling;
+        child->p_sibling = NULL;
+        remove_proctree(child);
+        proc_destroy(child);
+    }
     
-    for(int i = 1; i < arraysize; i++) {
-        struct proc *new = array_get(proctree, i);
-        if(new != NULL && new->parent_pid == exit_pid){
-            int new_state = new->state;
-            if(new_state == 1){
-                new->parent_pid = -1;
-            } else if(new_state == 0){
-                KASSERT(new != NULL);
-                array_set(proctree, new->curpid,NULL);
-                proc_destroy(new);
-                count--;
+    while(!done){
+        spinlock_acquire(&p->p_lock);
+        parent = p->p_parent;
+        if(parent == NULL){
+            /* no parent to collect the exit status */
+            p->state = 0;
+            p->exitcode = status;
+            spinlock_release(&p->p_lock);
+            DEBUG(DB_EXEC, "start proc_exit\n");
+            remove_proctree(p);
+            proc_destroy(p);
+            DEBUG(DB_EXEC, "end proc_exit\n");
+            return;
+        }
+        ppid = parent->curpid;
+        spinlock_release(&p->p_lock);
+        
+        /*
+         * The parent orphans us before it leaves the table, and can't
+         * leave while we hold its bucket; so if it is still there it
+         * is safe to lock, and if it isn't we'll see we're orphaned.
+         */
+        pb = PROC_BUCKET(PROC_SLOT(ppid));
+        spinlock_acquire(&pb->pb_lock);
+        if(proc_lookup(ppid) == parent){
+            spinlock_acquire(&parent->p_lock);
+            spinlock_acquire(&p->p_lock);
+            if(p->p_parent == parent){
+                p->state = 0; // exit code
+                p->exitcode = status;
+                /* the parent checks state holding its p_lock, so this can't be missed */
+                wchan_wakeall(parent->p_childwait);
+                done = true;
             }
+            spinlock_release(&p->p_lock);
+            spinlock_release(&parent->p_lock);
         }
+        spinlock_release(&pb->pb_lock);
     }
+}
+
+/*
+ * Count p's user threads other than SELF that are still around, or
+ * with RUNNINGONLY, that are not already on their way out. p_lock
+ * must be held.
+ */
+static unsigned proc_otherthreads(struct proc *p, unsigned self, bool runningonly){
+    unsigned i, n = 0;
+    KASSERT(spinlock_do_i_hold(&p->p_lock));
+    for(i = 0; i < AS_NTHREADSTACKS; i++){
+        if(i == self){
+            continue;
+        }
+        if(p->p_uthreads[i].ut_state == UT_RUNNING ||
+           (!runningonly && p->p_uthreads[i].ut_state == UT_EXITING)){
+            n++;
+        }
+    }
+    return n;
+}
+
+int proc_singlethread(bool exiting){
+    struct proc *p = curproc;
+    unsigned self = curthread->t_utid;
     
-    // no parent, just remove children p
-    if(p->parent_pid == -1){
-        //kprintf("Here!!come remove proctree\n");
-        DEBUG(DB_EXEC, "start proc_exit\n");
-        KASSERT(p != NULL);
-        array_set(proctree, p->curpid, NULL);
-        //kprintf("Here!!come proc destroy\n");
-        proc_destroy(p);
-        count--;
-        //kprintf("Here!!leave proc destroy\n");
-        DEBUG(DB_EXEC, "end proc_exit\n");
-        //kprintf("Here!!leave remove proctree\n");
-    } else {
-        cv_signal(p->wait, proc_lock);
+    spinlock_acquire(&p->p_lock);
+    if(p->p_exiting){
+        spinlock_release(&p->p_lock);
+        return EINTR;
+    }
+    p->p_exiting = true;
+    /* threads stuck in thread_join or on a futex give up */
+    wchan_wakeall(p->p_threadwait);
+    spinlock_release(&p->p_lock);
+    /* a vfork child's address space is its parent's, futexes and all */
+    if(p->p_vforksem == NULL){
+        futex_wakeall(p->p_addrspace);
+    }
+    spinlock_acquire(&p->p_lock);
+    /*
+     * The others notice p_exiting on their way back to user mode.
+     * Anything sleeping in the kernel for a long time holds us up
+     * until it wakes.
+     */
+    while(proc_otherthreads(p, self, false) > 0){
+        wchan_lock(p->p_threadwait);
+        spinlock_release(&p->p_lock);
+        wchan_sleep(p->p_threadwait);
+        spinlock_acquire(&p->p_lock);
+    }
+    if(!exiting){
+        p->p_exiting = false;
+    }
+    spinlock_release(&p->p_lock);
+    return 0;
+}
+
+void proc_becomemain(void){
+    struct proc *p = curproc;
+    
+    spinlock_acquire(&p->p_lock);
+    KASSERT(proc_otherthreads(p, curthread->t_utid, false) == 0);
+    for(unsigned i = 0; i < AS_NTHREADSTACKS; i++){
+        p->p_uthreads[i].ut_state = UT_FREE;
+    }
+    p->p_uthreads[0].ut_state = UT_RUNNING;
+    curthread->t_utid = 0;
+    spinlock_release(&p->p_lock);
+}
+
+void proc_threadleave(int exitcode){
+    struct proc *p = curproc;
+    unsigned self = curthread->t_utid;
+    struct addrspace *as;
+    
+    spinlock_acquire(&p->p_lock);
+    KASSERT(p->p_uthreads[self].ut_state == UT_RUNNING ||
+            p->p_uthreads[self].ut_state == UT_EXITING);
+    p->p_uthreads[self].ut_state = UT_EXITING;
+    as = p->p_addrspace;
+    spinlock_release(&p->p_lock);
+    
+    /* the main stack stays; it goes with the address space */
+    if(self != 0){
+        as_remove_threadstack(as, self);
+    }
+    as_deactivate();
+    proc_remthread(curthread);
+    
+    /* whoever is waiting may destroy p as soon as we let go */
+    spinlock_acquire(&p->p_lock);
+    p->p_uthreads[self].ut_state = UT_EXITED;
+    p->p_uthreads[self].ut_exitcode = exitcode;
+    wchan_wakeall(p->p_threadwait);
+    spinlock_release(&p->p_lock);
+    
+    thread_exit();
+}
+
+void proc_terminate(int status){
+    struct proc *p = curproc;
+    struct addrspace *as;
+    
+    /* take the other threads down first; if someone beat us to it, just go */
+    if(proc_singlethread(true)){
+        proc_threadleave(status);
+    }
+    KASSERT(p->p_addrspace != NULL);
+    as_deactivate();
+    /*
+     * clear p_addrspace before calling as_destroy. Otherwise if
+     * as_destroy sleeps (which is quite possible) when we
+     * come back we'll be calling as_activate on a
+     * half-destroyed address space.
+     */
+    as = curproc_setas(NULL);
+    /* a vfork child's address space goes back to its parent */
+    if(!proc_vforkdone(p)){
+        as_destroy(as);
+    }
+    
+    /* note: curproc cannot be used after this call */
+    proc_remthread(curthread);
+    /* close our files now, rather than when we are collected */
+    if(p->p_filetable != NULL){
+        filetable_destroy(p->p_filetable);
+        p->p_filetable = NULL;
+    }
+    proc_exit(p, status);
+    
+    thread_exit();
+}
+
+/*
+ * Per-thread accounting report, for the menu. Each thread is copied
+ * out under its process's lock, with the table bucket held to keep
+ * the process from going away meanwhile, and printed afterwards.
+ */
+struct ps_entry {
+    char pe_name[THREAD_NAMESIZE];
+    threadstate_t pe_state;
+    unsigned pe_cpu;
+    uint64_t pe_runtime;
+    uint64_t pe_waittime;
+    unsigned pe_nvcsw;
+    unsigned pe_nivcsw;
+};
+
+static const char *const ps_statenames[] = { "run", "ready", "sleep", "zombie" };
+
+void proc_printthreads(void){
+    struct proc_bucket *pb;
+    struct ps_entry pe;
+    struct proc *p;
+    struct thread *t;
+    pid_t pid = 0;
+    bool found;
+
+    kprintf("%5s %-24s %-6s %3s %12s %12s %8s %8s\n", "pid", "thread",
+            "state", "cpu", "run us", "wait us", "vcsw", "ivcsw");
+
+    for(unsigned slot = 1; slot < PROC_NSLOTS; slot++){
+        pb = PROC_BUCKET(slot);
+        for(unsigned i = 0; ; i++){
+            found = false;
+            spinlock_acquire(&pb->pb_lock);
+            p = proc_table[slot];
+            if(p != NULL){
+                pid = p->curpid;
+                spinlock_acquire(&p->p_lock);
+                if(i < threadarray_num(&p->p_threads)){
+                    t = threadarray_get(&p->p_threads, i);
+                    snprintf(pe.pe_name, sizeof(pe.pe_name), "%s", t->t_name);
+                    pe.pe_state = t->t_state;
+                    pe.pe_cpu = t->t_cpu->c_number;
+                    pe.pe_runtime = thread_runtime(t);
+                    pe.pe_waittime = t->t_waittime;
+                    pe.pe_nvcsw = t->t_nvcsw;
+                    pe.pe_nivcsw = t->t_nivcsw;
+                    found = true;
+                }
+                spinlock_release(&p->p_lock);
+            }
+            spinlock_release(&pb->pb_lock);
+            if(!found){
+                break;
+            }
+            kprintf("%5d %-24s %-6s %3u %12llu %12llu %8u %8u\n", pid,
+                    pe.pe_name, ps_statenames[pe.pe_state], pe.pe_cpu,
+                    (unsigned long long)(pe.pe_runtime / 1000),
+                    (unsigned long long)(pe.pe_waittime / 1000),
+                    pe.pe_nvcsw, pe.pe_nivcsw);
+        }
+    }
+}
+
+void proc_checkexit(void){
+    struct proc *p = curproc;
+    /* unlocked peek; if we miss it we'll see it on the next trap */
+    if(p != NULL && p != kproc && p->p_exiting){
+        proc_threadleave(0);
     }
-    //kprintf("Here!!leave remove proctree!!\n");
 }
 
 #endif // OPT_A2
@@ -174,11 +569,27 @@ proc_create(const char *name)
 	}
 
 #if OPT_A2
-    proc->wait = cv_create("newcvproc");
-    if(proc->wait == NULL){
+    proc->p_childwait = wchan_create("proc_childwait");
+    if(proc->p_childwait == NULL){
+        kfree(proc->p_name);
         kfree(proc);
         return NULL;
     }
+    proc->p_threadwait = wchan_create("proc_threadwait");
+    if(proc->p_threadwait == NULL){
+        wchan_destroy(proc->p_childwait);
+        kfree(proc->p_name);
+        kfree(proc);
+        return NULL;
+    }
+    for(unsigned i = 0; i < AS_NTHREADSTACKS; i++){
+        proc->p_uthreads[i].ut_state = UT_FREE;
+        proc->p_uthreads[i].ut_exitcode = 0;
+    }
+    /* the thread it is created for is thread 0 */
+    proc->p_uthreads[0].ut_state = UT_RUNNING;
+    proc->p_exiting = false;
+    proc->p_vforksem = NULL;
 #endif // OPT_A2
     
 	threadarray_init(&proc->p_threads);
@@ -189,6 +600,13 @@ proc_create(const char *name)
 
 	/* VFS fields */
 	proc->p_cwd = NULL;
+	proc->p_filetable = NULL;
+
+	/* Accounting fields */
+	proc->p_runtime = 0;
+	proc->p_waittime = 0;
+	proc->p_nvcsw = 0;
+	proc->p_nivcsw = 0;
 
 #ifdef UW
 	proc->console = NULL;
@@ -198,18 +616,19 @@ proc_create(const char *name)
     int err = 0;
     proc->curpid = -1;
 
-    if(kproc == NULL){
+    if(kproc == NULL || curproc == kproc){
         err = add_proctree(proc, NULL);
     } else {
-        lock_acquire(proc_lock);
-        if(curproc != kproc){
-            err = add_proctree(proc, curproc);
-        } else {
-            err = add_proctree(proc, NULL);
-        }
-        lock_release(proc_lock);
+        err = add_proctree(proc, curproc);
     }
     if(err){
+        /* no pid for it */
+        wchan_destroy(proc->p_threadwait);
+        wchan_destroy(proc->p_childwait);
+        threadarray_cleanup(&proc->p_threads);
+        spinlock_cleanup(&proc->p_lock);
+        kfree(proc->p_name);
+        kfree(proc);
         return NULL;
     }
 #endif // OPT_A2
@@ -242,6 +661,10 @@ proc_destroy(struct proc *proc)
      */
     
     /* VFS fields */
+    if (proc->p_filetable) {
+        filetable_destroy(proc->p_filetable);
+        proc->p_filetable = NULL;
+    }
     if (proc->p_cwd) {
         VOP_DECREF(proc->p_cwd);
         proc->p_cwd = NULL;
@@ -274,6 +697,11 @@ proc_destroy(struct proc *proc)
     //}
 #endif // UW
     
+#if OPT_A2
+    wchan_destroy(proc->p_childwait);
+    wchan_destroy(proc->p_threadwait);
+#endif // OPT_A2
+
     threadarray_cleanup(&proc->p_threads);
     spinlock_cleanup(&proc->p_lock);
     
@@ -306,12 +734,7 @@ void
 proc_bootstrap(void)
 {
 #if OPT_A2
-    proctree = array_create();
-    array_setsize(proctree, arraysize);
-    proc_lock = lock_create("proc_lock");
-    for(int i = 1; i < arraysize; i++){
-        array_set(proctree, i, NULL);
-    }
+    proctable_init();
 #endif // OPT_A2
   kproc = proc_create("[kernel]");
   if (kproc == NULL) {
@@ -341,6 +764,7 @@ proc_create_runprogram(const char *name)
 {
 	struct proc *proc;
 	char *console_path;
+	int result;
 
 	proc = proc_create(name);
 	if (proc == NULL) {
@@ -391,6 +815,25 @@ proc_create_runprogram(const char *name)
 	V(proc_count_mutex);
 #endif // UW
 
+	/* A child shares its parent's open files; a fresh process gets the console. */
+	if (curproc->p_filetable != NULL) {
+		proc->p_filetable = filetable_copy(curproc->p_filetable);
+		result = proc->p_filetable == NULL ? ENOMEM : 0;
+	}
+	else {
+		proc->p_filetable = filetable_create();
+		result = proc->p_filetable == NULL ? ENOMEM :
+			filetable_openconsole(proc->p_filetable);
+	}
+	if (result) {
+#if OPT_A2
+		proc_discard(proc);
+#else
+		proc_destroy(proc);
+#endif // OPT_A2
+		return NULL;
+	}
+
 	return proc;
 }
 
@@ -423,12 +866,21 @@ void
 proc_remthread(struct thread *t)
 {
 	struct proc *proc;
+	uint64_t runtime;
 	unsigned i, num;
 
 	proc = t->t_proc;
 	KASSERT(proc != NULL);
 
+	runtime = thread_runtime(t);
+
 	spinlock_acquire(&proc->p_lock);
+	/* keep its accounting for proc_getrusage */
+	proc->p_runtime += runtime;
+	proc->p_waittime += t->t_waittime;
+	proc->p_nvcsw += t->t_nvcsw;
+	proc->p_nivcsw += t->t_nivcsw;
+
 	/* ugh: find the thread in the array */
 	num = threadarray_num(&proc->p_threads);
 	for (i=0; i<num; i++) {
@@ -444,6 +896,52 @@ proc_remthread(struct thread *t)
 	panic("Thread (%p) has escaped from its process (%p)\n", t, proc);
 }
 
+/*
+ * Convert nanoseconds to a struct timeval.
+ */
+static
+void
+proc_ns2timeval(uint64_t ns, struct timeval *tv)
+{
+	tv->tv_sec = ns / 1000000000;
+	tv->tv_usec = (ns % 1000000000) / 1000;
+}
+
+/*
+ * Fill in the parts of a struct rusage we keep track of. We don't
+ * split user and system time, so all cpu time is reported in
+ * ru_utime. Time spent waiting for a cpu goes in ru_wtime.
+ */
+void
+proc_getrusage(struct proc *proc, struct rusage *ru)
+{
+	struct thread *t;
+	uint64_t runtime, waittime;
+	unsigned i, num, nvcsw, nivcsw;
+
+	bzero(ru, sizeof(*ru));
+
+	spinlock_acquire(&proc->p_lock);
+	runtime = proc->p_runtime;
+	waittime = proc->p_waittime;
+	nvcsw = proc->p_nvcsw;
+	nivcsw = proc->p_nivcsw;
+	num = threadarray_num(&proc->p_threads);
+	for (i=0; i<num; i++) {
+		t = threadarray_get(&proc->p_threads, i);
+		runtime += thread_runtime(t);
+		waittime += t->t_waittime;
+		nvcsw += t->t_nvcsw;
+		nivcsw += t->t_nivcsw;
+	}
+	spinlock_release(&proc->p_lock);
+
+	proc_ns2timeval(runtime, &ru->ru_utime);
+	proc_ns2timeval(waittime, &ru->ru_wtime);
+	ru->ru_nvcsw = nvcsw;
+	ru->ru_nivcsw = nivcsw;
+}
+
 /*
  * Fetch the address space of the current process. Caution: it isn't
  * refcounted. If you implement multithreaded processes, make sure to
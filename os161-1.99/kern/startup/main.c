@@ -48,8 +48,12 @@
 #include <device.h>
 #include <syscall.h>
 #include <test.h>
+#include <lockstat.h>
+#include <futex.h>
+#include <workqueue.h>
 #include <version.h>
 #include "autoconf.h"  // for pseudoconfig
+#include "opt-lockstat.h"
 
 
 /*
@@ -111,6 +115,7 @@ boot(void)
 	thread_bootstrap();
 	hardclock_bootstrap();
 	vfs_bootstrap();
+	futex_bootstrap();
 
 	/* Probe and initialize devices. Interrupts should come on. */
 	kprintf("Device probe...\n");
@@ -120,11 +125,18 @@ boot(void)
 	/* Now do pseudo-devices. */
 	pseudoconfig();
 	kprintf("\n");
+#if OPT_LOCKSTAT
+	/* Needs the clock, which mainbus_bootstrap attached. */
+	lockstat_bootstrap();
+#endif
+	/* Also needs the clock. */
+	thread_stats_bootstrap();
 
 	/* Late phase of initialization. */
 	vm_bootstrap();
 	kprintf_bootstrap();
 	thread_start_cpus();
+	workqueue_bootstrap();
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
 	vfs_setbootfs("emu0");
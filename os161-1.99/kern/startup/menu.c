@@ -35,6 +35,7 @@
 #include <lib.h>
 #include <uio.h>
 #include <clock.h>
+#include <cpu.h>
 #include <thread.h>
 #include <proc.h>
 #include <synch.h>
@@ -42,9 +43,12 @@
 #include <sfs.h>
 #include <syscall.h>
 #include <test.h>
+#include <lockstat.h>
+#include <prof.h>
 #include "opt-synchprobs.h"
 #include "opt-sfs.h"
 #include "opt-net.h"
+#include "opt-lockstat.h"
 
 
 /*
@@ -401,6 +405,178 @@ cmd_kheapstats(int nargs, char **args)
 	return 0;
 }
 
+/*
+ * Per-cpu timer tick statistics: how many hardclocks each cpu took,
+ * how many it skipped while idle, and how many time-slice yields it
+ * skipped because nothing else was runnable.
+ */
+static
+int
+cmd_tickstats(int nargs, char **args)
+{
+	struct cpu *c;
+	unsigned i;
+
+	(void)nargs;
+	(void)args;
+
+	for (i=0; i<cpu_count(); i++) {
+		c = cpu_get(i);
+		kprintf("cpu%u: %u hardclocks, %u elided while idle, "
+			"%u yields elided\n", c->c_number, c->c_hardclocks,
+			c->c_elidedticks, c->c_elidedyields);
+	}
+	return 0;
+}
+
+/*
+ * Per-cpu interprocessor interrupt statistics: how many IPIs each cpu
+ * was sent, and how many more were folded into ones already due.
+ */
+static
+int
+cmd_ipistats(int nargs, char **args)
+{
+	struct cpu *c;
+	unsigned i;
+
+	(void)nargs;
+	(void)args;
+
+	for (i=0; i<cpu_count(); i++) {
+		c = cpu_get(i);
+		kprintf("cpu%u: %u IPIs sent, %u coalesced\n", c->c_number,
+			c->c_ipisent, c->c_ipicoalesced);
+	}
+	return 0;
+}
+
+/*
+ * What each cpu is running and has queued, with priorities and
+ * affinity masks.
+ */
+static
+int
+cmd_runqueues(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	thread_print_runqueues();
+	return 0;
+}
+
+#if OPT_A2
+/*
+ * Command for per-thread accounting: cpu time, time spent runnable
+ * but waiting, and voluntary and involuntary context switches.
+ */
+static
+int
+cmd_ps(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	proc_printthreads();
+	return 0;
+}
+#endif
+
+/*
+ * Command for each cpu's histogram of scheduling latency.
+ */
+static
+int
+cmd_schedlat(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	thread_print_schedlat();
+	return 0;
+}
+
+/*
+ * Command for the sampling profiler.
+ *   prof on                  start sampling (discarding old samples)
+ *   prof off                 stop sampling
+ *   prof dump [N] [KERNEL]   print the top N functions (default 20),
+ *                            resolved with the symbols in KERNEL
+ */
+static
+int
+cmd_prof(int nargs, char **args)
+{
+	const char *kernel = "emu0:kernel";
+	int max = 20;
+
+	if (nargs == 2 && !strcmp(args[1], "on")) {
+		return prof_start();
+	}
+	if (nargs == 2 && !strcmp(args[1], "off")) {
+		prof_stop();
+		return 0;
+	}
+	if (nargs >= 2 && nargs <= 4 && !strcmp(args[1], "dump")) {
+		if (nargs >= 3) {
+			max = atoi(args[2]);
+		}
+		if (nargs == 4) {
+			kernel = args[3];
+		}
+		if (max > 0) {
+			prof_dump(kernel, max);
+			return 0;
+		}
+	}
+	kprintf("Usage: prof on | off | dump [N] [kernel]\n");
+	return EINVAL;
+}
+
+#if OPT_LOCKSTAT
+/*
+ * Command for lock contention statistics.
+ *   lockstat [N]     print the N most contended locks (default 10)
+ *   lockstat reset   zero the counters
+ *   lockstat on|off  start or stop collecting
+ */
+static
+int
+cmd_lockstat(int nargs, char **args)
+{
+	int max = 10;
+
+	if (nargs > 2) {
+		kprintf("Usage: lockstat [N | reset | on | off]\n");
+		return EINVAL;
+	}
+
+	if (nargs == 2) {
+		if (!strcmp(args[1], "reset")) {
+			lockstat_reset();
+			return 0;
+		}
+		if (!strcmp(args[1], "on")) {
+			lockstat_enabled = true;
+			return 0;
+		}
+		if (!strcmp(args[1], "off")) {
+			lockstat_enabled = false;
+			return 0;
+		}
+		max = atoi(args[1]);
+		if (max <= 0) {
+			kprintf("Usage: lockstat [N | reset | on | off]\n");
+			return EINVAL;
+		}
+	}
+
+	lockstat_print(max);
+	return 0;
+}
+#endif /* OPT_LOCKSTAT */
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -470,6 +646,10 @@ static const char *testmenu[] = {
 	"[sy1] Semaphore test                ",
 	"[sy2] Lock test             (1)     ",
 	"[sy3] CV test               (1)     ",
+	"[sy4] Rwlock test                   ",
+	"[sy5] Priority inheritance test     ",
+	"[tm1] Callout/timed sleep test      ",
+	"[wq1] Workqueue test                ",
 #ifdef UW
 	"[uw1] UW lock test          (1)     ",
 	"[uw2] UW vmstats test       (3)     ",
@@ -510,6 +690,17 @@ static const char *mainmenu[] = {
 #endif /* UW */
 #endif
 	"[kh] Kernel heap stats              ",
+	"[ticks] Timer tick stats            ",
+	"[ipis] IPI stats                    ",
+	"[runq] Run queues by cpu            ",
+#if OPT_A2
+	"[ps] Thread cpu and switch stats    ",
+#endif
+	"[schedlat] Scheduling latency       ",
+	"[prof] Sampling profiler            ",
+#if OPT_LOCKSTAT
+	"[lockstat] Lock contention stats    ",
+#endif
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -581,6 +772,17 @@ static struct {
 
 	/* stats */
 	{ "kh",         cmd_kheapstats },
+	{ "ticks",	cmd_tickstats },
+	{ "ipis",	cmd_ipistats },
+	{ "runq",	cmd_runqueues },
+#if OPT_A2
+	{ "ps",		cmd_ps },
+#endif
+	{ "schedlat",	cmd_schedlat },
+	{ "prof",	cmd_prof },
+#if OPT_LOCKSTAT
+	{ "lockstat",	cmd_lockstat },
+#endif
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -598,6 +800,10 @@ static struct {
 	/* synchronization assignment tests */
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
+	{ "sy4",	rwtest },
+	{ "sy5",	pitest },
+	{ "tm1",	callouttest },
+	{ "wq1",	workqueuetest },
 #ifdef UW
 	{ "uw1",	uwlocktest1 },
 	{ "uw2",	uwvmstatstest },
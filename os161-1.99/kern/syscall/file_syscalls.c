@@ -1,60 +1,489 @@
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/seek.h>
+#include <kern/stat.h>
 #include <kern/unistd.h>
 #include <lib.h>
+#include <limits.h>
 #include <uio.h>
 #include <syscall.h>
 #include <vnode.h>
 #include <vfs.h>
+#include <synch.h>
 #include <current.h>
 #include <proc.h>
+#include <copyinout.h>
+#include <filetable.h>
 
-/* handler for write() system call                  */
 /*
- * n.b.
- * This implementation handles only writes to standard output 
- * and standard error, both of which go to the console.
- * Also, it does not provide any synchronization, so writes
- * are not atomic.
- *
- * You will need to improve this implementation
+ * File system calls. Descriptors are looked up in the process's
+ * filetable (see <filetable.h>), which hands back the open file with
+ * a reference held for the duration of the call.
  */
 
+/*
+ * Copy a path in from userland into a fresh PATH_MAX buffer, which
+ * the caller frees.
+ */
+static
 int
-sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval)
+copyinpath(const_userptr_t upath, char **ret)
 {
-  struct iovec iov;
+  char *path;
+  int res;
+
+  path = kmalloc(PATH_MAX);
+  if (path == NULL) {
+    return ENOMEM;
+  }
+  res = copyinstr(upath, path, PATH_MAX, NULL);
+  if (res) {
+    kfree(path);
+    return res;
+  }
+  *ret = path;
+  return 0;
+}
+
+/*
+ * Largest total transfer: the count returned has to fit in an int.
+ */
+#define RW_MAXLEN 0x7fffffff
+
+/*
+ * readv and writev vectors up to this long are copied in on the stack.
+ */
+#define RW_NIOV 8
+
+/*
+ * Common code for the read and write calls: move up to LEN bytes
+ * between the file open on FD and the IOVCNT user buffers in IOV,
+ * whose lengths add up to LEN. The iovecs are used up in the process.
+ *
+ * Plain read and write use the open file's offset and advance it.
+ * The offset lock is held across the I/O, so each read or write on
+ * a shared open file happens at a distinct position. Devices have no
+ * offset and aren't locked; concurrent console output may interleave.
+ *
+ * Positional I/O (POSITIONAL true) happens at POS instead, and
+ * neither uses nor takes the offset lock, so threads working on
+ * different parts of one open file don't hold each other up. As in
+ * BSD, O_APPEND doesn't apply to it.
+ */
+static
+int
+file_rw(int fd, struct iovec *iov, unsigned iovcnt, size_t len,
+	bool positional, off_t pos, enum uio_rw rw, int *retval)
+{
+  struct openfile *of;
   struct uio u;
+  struct stat st;
+  bool locked;
   int res;
 
-  DEBUG(DB_SYSCALL,"Syscall: write(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
-  
-  /* only stdout and stderr writes are currently implemented */
-  if (!((fdesc==STDOUT_FILENO)||(fdesc==STDERR_FILENO))) {
-    return EUNIMP;
+  res = filetable_get(curproc->p_filetable, fd, &of);
+  if (res) {
+    return res;
+  }
+  if ((rw == UIO_READ && of->of_accmode == O_WRONLY) ||
+      (rw == UIO_WRITE && of->of_accmode == O_RDONLY)) {
+    openfile_decref(of);
+    return EBADF;
+  }
+  if (positional && !of->of_seekable) {
+    openfile_decref(of);
+    return ESPIPE;
+  }
+  if (positional && pos < 0) {
+    openfile_decref(of);
+    return EINVAL;
   }
-  KASSERT(curproc != NULL);
-  KASSERT(curproc->console != NULL);
-  KASSERT(curproc->p_addrspace != NULL);
 
-  /* set up a uio structure to refer to the user program's buffer (ubuf) */
-  iov.iov_ubase = ubuf;
-  iov.iov_len = nbytes;
-  u.uio_iov = &iov;
-  u.uio_iovcnt = 1;
-  u.uio_offset = 0;  /* not needed for the console */
-  u.uio_resid = nbytes;
+  locked = of->of_seekable && !positional;
+  if (locked) {
+    lock_acquire(of->of_lock);
+    if (rw == UIO_WRITE && of->of_append) {
+      res = VOP_STAT(of->of_vnode, &st);
+      if (res) {
+        goto out;
+      }
+      of->of_offset = st.st_size;
+    }
+    pos = of->of_offset;
+  }
+  else if (!positional) {
+    pos = 0;  /* not needed for devices */
+  }
+
+  /* set up a uio structure to refer to the user program's buffers */
+  u.uio_iov = iov;
+  u.uio_iovcnt = iovcnt;
+  u.uio_offset = pos;
+  u.uio_resid = len;
   u.uio_segflg = UIO_USERSPACE;
-  u.uio_rw = UIO_WRITE;
+  u.uio_rw = rw;
   u.uio_space = curproc->p_addrspace;
 
-  res = VOP_WRITE(curproc->console,&u);
+  res = rw == UIO_READ ? VOP_READ(of->of_vnode, &u) :
+    VOP_WRITE(of->of_vnode, &u);
+  if (res == 0) {
+    if (locked) {
+      of->of_offset = u.uio_offset;
+    }
+    /* pass back the number of bytes actually transferred */
+    *retval = len - u.uio_resid;
+    KASSERT(*retval >= 0);
+  }
+
+ out:
+  if (locked) {
+    lock_release(of->of_lock);
+  }
+  openfile_decref(of);
+  return res;
+}
+
+/*
+ * Single-buffer read and write.
+ */
+static
+int
+file_rw1(int fd, userptr_t ubuf, size_t len, bool positional, off_t pos,
+	 enum uio_rw rw, int *retval)
+{
+  struct iovec iov;
+
+  iov.iov_ubase = ubuf;
+  iov.iov_len = len;
+  return file_rw(fd, &iov, 1, len, positional, pos, rw, retval);
+}
+
+/*
+ * readv and writev: copy in the IOVCNT iovecs at UIOV and do the lot
+ * as one transfer. Short vectors stay on the stack.
+ */
+static
+int
+file_rwv(int fd, const_userptr_t uiov, int iovcnt, enum uio_rw rw,
+	 int *retval)
+{
+  struct iovec stackiov[RW_NIOV];
+  struct iovec *iov;
+  size_t len;
+  int i, res;
+
+  if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+    return EINVAL;
+  }
+  if (iovcnt <= RW_NIOV) {
+    iov = stackiov;
+  }
+  else {
+    iov = kmalloc(iovcnt * sizeof(*iov));
+    if (iov == NULL) {
+      return ENOMEM;
+    }
+  }
+
+  res = copyin(uiov, iov, iovcnt * sizeof(*iov));
+  if (res) {
+    goto out;
+  }
+  len = 0;
+  for (i=0; i<iovcnt; i++) {
+    if (iov[i].iov_len > RW_MAXLEN - len) {
+      res = EINVAL;
+      goto out;
+    }
+    len += iov[i].iov_len;
+  }
+
+  res = file_rw(fd, iov, iovcnt, len, false, 0, rw, retval);
+
+ out:
+  if (iov != stackiov) {
+    kfree(iov);
+  }
+  return res;
+}
+
+int
+sys_open(userptr_t upath, int flags, mode_t mode, int *retval)
+{
+  struct openfile *of;
+  char *path;
+  int res;
+
+  DEBUG(DB_SYSCALL,"Syscall: open(%x,%x)\n",(unsigned int)upath,flags);
+
+  if ((flags & O_ACCMODE) == O_ACCMODE) {
+    return EINVAL;
+  }
+  res = copyinpath(upath, &path);
+  if (res) {
+    return res;
+  }
+  res = openfile_open(path, flags, mode, &of);
+  kfree(path);
   if (res) {
     return res;
   }
+  res = filetable_place(curproc->p_filetable, of, retval);
+  if (res) {
+    openfile_decref(of);
+  }
+  return res;
+}
 
-  /* pass back the number of bytes actually written */
-  *retval = nbytes - u.uio_resid;
-  KASSERT(*retval >= 0);
+int
+sys_read(int fdesc, userptr_t ubuf, size_t nbytes, int *retval)
+{
+  DEBUG(DB_SYSCALL,"Syscall: read(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
+  return file_rw1(fdesc, ubuf, nbytes, false, 0, UIO_READ, retval);
+}
+
+/* handler for write() system call                  */
+int
+sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval)
+{
+  DEBUG(DB_SYSCALL,"Syscall: write(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
+  return file_rw1(fdesc, ubuf, nbytes, false, 0, UIO_WRITE, retval);
+}
+
+int
+sys_readv(int fdesc, const_userptr_t uiov, int iovcnt, int *retval)
+{
+  return file_rwv(fdesc, uiov, iovcnt, UIO_READ, retval);
+}
+
+int
+sys_writev(int fdesc, const_userptr_t uiov, int iovcnt, int *retval)
+{
+  return file_rwv(fdesc, uiov, iovcnt, UIO_WRITE, retval);
+}
+
+int
+sys_pread(int fdesc, userptr_t ubuf, size_t nbytes, off_t pos, int *retval)
+{
+  return file_rw1(fdesc, ubuf, nbytes, true, pos, UIO_READ, retval);
+}
+
+int
+sys_pwrite(int fdesc, userptr_t ubuf, size_t nbytes, off_t pos, int *retval)
+{
+  return file_rw1(fdesc, ubuf, nbytes, true, pos, UIO_WRITE, retval);
+}
+
+int
+sys_lseek(int fdesc, off_t pos, int whence, off_t *retval)
+{
+  struct openfile *of;
+  struct stat st;
+  off_t newpos;
+  int res;
+
+  res = filetable_get(curproc->p_filetable, fdesc, &of);
+  if (res) {
+    return res;
+  }
+  if (!of->of_seekable) {
+    openfile_decref(of);
+    return ESPIPE;
+  }
+
+  lock_acquire(of->of_lock);
+  switch (whence) {
+  case SEEK_SET:
+    newpos = pos;
+    break;
+  case SEEK_CUR:
+    newpos = of->of_offset + pos;
+    break;
+  case SEEK_END:
+    res = VOP_STAT(of->of_vnode, &st);
+    newpos = st.st_size + pos;
+    break;
+  default:
+    res = EINVAL;
+    break;
+  }
+  if (res == 0 && newpos < 0) {
+    res = EINVAL;
+  }
+  if (res == 0) {
+    of->of_offset = newpos;
+    *retval = newpos;
+  }
+  lock_release(of->of_lock);
+  openfile_decref(of);
+  return res;
+}
+
+int
+sys_close(int fdesc)
+{
+  struct openfile *of;
+  int res;
+
+  res = filetable_remove(curproc->p_filetable, fdesc, &of);
+  if (res) {
+    return res;
+  }
+  openfile_decref(of);
   return 0;
 }
+
+int
+sys_fsync(int fdesc)
+{
+  struct openfile *of;
+  int res;
+
+  res = filetable_get(curproc->p_filetable, fdesc, &of);
+  if (res) {
+    return res;
+  }
+  res = VOP_FSYNC(of->of_vnode);
+  openfile_decref(of);
+  return res;
+}
+
+int
+sys_dup2(int oldfd, int newfd, int *retval)
+{
+  struct openfile *of, *old;
+  int res;
+
+  if (newfd < 0 || newfd >= OPEN_MAX) {
+    return EBADF;
+  }
+  res = filetable_get(curproc->p_filetable, oldfd, &of);
+  if (res) {
+    return res;
+  }
+  if (oldfd == newfd) {
+    openfile_decref(of);
+    *retval = newfd;
+    return 0;
+  }
+  /* the table takes over our reference */
+  res = filetable_placeat(curproc->p_filetable, of, newfd, &old);
+  if (res) {
+    openfile_decref(of);
+    return res;
+  }
+  if (old != NULL) {
+    openfile_decref(old);
+  }
+  *retval = newfd;
+  return 0;
+}
+
+int
+sys_fstat(int fdesc, userptr_t ustat)
+{
+  struct openfile *of;
+  struct stat st;
+  int res;
+
+  res = filetable_get(curproc->p_filetable, fdesc, &of);
+  if (res) {
+    return res;
+  }
+  res = VOP_STAT(of->of_vnode, &st);
+  openfile_decref(of);
+  if (res) {
+    return res;
+  }
+  return copyout(&st, ustat, sizeof(st));
+}
+
+int
+sys_stat(userptr_t upath, userptr_t ustat)
+{
+  struct vnode *vn;
+  struct stat st;
+  char *path;
+  int res;
+
+  res = copyinpath(upath, &path);
+  if (res) {
+    return res;
+  }
+  res = vfs_lookup(path, &vn);
+  kfree(path);
+  if (res) {
+    return res;
+  }
+  res = VOP_STAT(vn, &st);
+  VOP_DECREF(vn);
+  if (res) {
+    return res;
+  }
+  return copyout(&st, ustat, sizeof(st));
+}
+
+/*
+ * The calls that just take a path and hand it to the VFS layer.
+ */
+
+int
+sys_chdir(userptr_t upath)
+{
+  char *path;
+  int res;
+
+  res = copyinpath(upath, &path);
+  if (res) {
+    return res;
+  }
+  res = vfs_chdir(path);
+  kfree(path);
+  return res;
+}
+
+int
+sys_mkdir(userptr_t upath, mode_t mode)
+{
+  char *path;
+  int res;
+
+  res = copyinpath(upath, &path);
+  if (res) {
+    return res;
+  }
+  res = vfs_mkdir(path, mode);
+  kfree(path);
+  return res;
+}
+
+int
+sys_rmdir(userptr_t upath)
+{
+  char *path;
+  int res;
+
+  res = copyinpath(upath, &path);
+  if (res) {
+    return res;
+  }
+  res = vfs_rmdir(path);
+  kfree(path);
+  return res;
+}
+
+int
+sys_remove(userptr_t upath)
+{
+  char *path;
+  int res;
+
+  res = copyinpath(upath, &path);
+  if (res) {
+    return res;
+  }
+  res = vfs_remove(path);
+  kfree(path);
+  return res;
+}
@@ -0,0 +1,224 @@
+/*
+ * Futex system calls. See <futex.h>.
+ *
+ * Each hash bucket has a sleep lock and a list of the words that
+ * currently have waiters, each with its own wait channel. A waiter
+ * checks the word and gets onto the channel without letting go of
+ * the bucket lock, and a waker needs the bucket lock to find the
+ * channel, so a wakeup can't fall in between.
+ */
+
+#include "opt-A2.h"
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <copyinout.h>
+#include <synch.h>
+#include <wchan.h>
+#include <current.h>
+#include <proc.h>
+#include <futex.h>
+#include <syscall.h>
+
+/* Number of hash buckets. Must be a power of 2. */
+#define FUTEX_NBUCKETS	64
+
+struct futex {
+	struct futex *f_next;		/* bucket list */
+	struct addrspace *f_as;		/* key */
+	vaddr_t f_addr;
+	unsigned f_waiters;		/* threads asleep on f_wchan */
+	struct wchan *f_wchan;
+};
+
+struct futexbucket {
+	struct lock *fb_lock;
+	struct futex *fb_list;
+};
+
+static struct futexbucket futex_buckets[FUTEX_NBUCKETS];
+
+void
+futex_bootstrap(void)
+{
+	unsigned i;
+
+	for (i=0; i<FUTEX_NBUCKETS; i++) {
+		futex_buckets[i].fb_lock = lock_create("futex");
+		if (futex_buckets[i].fb_lock == NULL) {
+			panic("futex_bootstrap: Out of memory\n");
+		}
+		futex_buckets[i].fb_list = NULL;
+	}
+}
+
+static
+struct futexbucket *
+futex_bucket(struct addrspace *as, vaddr_t addr)
+{
+	unsigned h;
+
+	/* words are 4-aligned; address spaces are kmalloc'd */
+	h = (addr >> 2) ^ ((vaddr_t)as >> 4);
+	h ^= h >> 11;
+	return &futex_buckets[h & (FUTEX_NBUCKETS - 1)];
+}
+
+/*
+ * Find the futex for (AS, ADDR) in FB, or NULL. The bucket must be
+ * locked.
+ */
+static
+struct futex *
+futex_lookup(struct futexbucket *fb, struct addrspace *as, vaddr_t addr)
+{
+	struct futex *f;
+
+	KASSERT(lock_do_i_hold(fb->fb_lock));
+	for (f = fb->fb_list; f != NULL; f = f->f_next) {
+		if (f->f_as == as && f->f_addr == addr) {
+			return f;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Take a futex with no waiters left out of its bucket and free it.
+ * The bucket must be locked.
+ */
+static
+void
+futex_destroy(struct futexbucket *fb, struct futex *f)
+{
+	struct futex **fp;
+
+	KASSERT(lock_do_i_hold(fb->fb_lock));
+	KASSERT(f->f_waiters == 0);
+
+	for (fp = &fb->fb_list; *fp != f; fp = &(*fp)->f_next) {
+		KASSERT(*fp != NULL);
+	}
+	*fp = f->f_next;
+	wchan_destroy(f->f_wchan);
+	kfree(f);
+}
+
+int
+sys_futex_wait(userptr_t uaddr, int val)
+{
+	struct addrspace *as = curproc_getas();
+	vaddr_t addr = (vaddr_t)uaddr;
+	struct futexbucket *fb;
+	struct futex *f;
+	int cur, result;
+
+	if (addr % sizeof(int) != 0) {
+		return EINVAL;
+	}
+	fb = futex_bucket(as, addr);
+
+	lock_acquire(fb->fb_lock);
+	result = copyin((const_userptr_t)uaddr, &cur, sizeof(cur));
+	if (result) {
+		goto out;
+	}
+	if (cur != val) {
+		/* changed already; go look again */
+		result = EAGAIN;
+		goto out;
+	}
+#if OPT_A2
+	/* futex_wakeall runs after this is set, and takes our bucket lock */
+	if (curproc->p_exiting) {
+		result = EINTR;
+		goto out;
+	}
+#endif
+
+	f = futex_lookup(fb, as, addr);
+	if (f == NULL) {
+		f = kmalloc(sizeof(*f));
+		if (f == NULL) {
+			result = ENOMEM;
+			goto out;
+		}
+		f->f_wchan = wchan_create("futex");
+		if (f->f_wchan == NULL) {
+			kfree(f);
+			result = ENOMEM;
+			goto out;
+		}
+		f->f_as = as;
+		f->f_addr = addr;
+		f->f_waiters = 0;
+		f->f_next = fb->fb_list;
+		fb->fb_list = f;
+	}
+
+	f->f_waiters++;
+	wchan_lock(f->f_wchan);
+	lock_release(fb->fb_lock);
+	wchan_sleep(f->f_wchan);
+	/* the waker did the bookkeeping, and may have freed f */
+	return 0;
+
+ out:
+	lock_release(fb->fb_lock);
+	return result;
+}
+
+int
+sys_futex_wake(userptr_t uaddr, int count, int *retval)
+{
+	struct addrspace *as = curproc_getas();
+	vaddr_t addr = (vaddr_t)uaddr;
+	struct futexbucket *fb;
+	struct futex *f;
+	int n;
+
+	if (addr % sizeof(int) != 0 || count < 0) {
+		return EINVAL;
+	}
+	fb = futex_bucket(as, addr);
+
+	n = 0;
+	lock_acquire(fb->fb_lock);
+	f = futex_lookup(fb, as, addr);
+	if (f != NULL) {
+		while (n < count && f->f_waiters > 0) {
+			wchan_wakeone(f->f_wchan);
+			f->f_waiters--;
+			n++;
+		}
+		if (f->f_waiters == 0) {
+			futex_destroy(fb, f);
+		}
+	}
+	lock_release(fb->fb_lock);
+
+	*retval = n;
+	return 0;
+}
+
+void
+futex_wakeall(struct addrspace *as)
+{
+	struct futexbucket *fb;
+	struct futex *f, *next;
+	unsigned i;
+
+	for (i=0; i<FUTEX_NBUCKETS; i++) {
+		fb = &futex_buckets[i];
+		lock_acquire(fb->fb_lock);
+		for (f = fb->fb_list; f != NULL; f = next) {
+			next = f->f_next;
+			if (f->f_as == as) {
+				wchan_wakeall(f->f_wchan);
+				f->f_waiters = 0;
+				futex_destroy(fb, f);
+			}
+		}
+		lock_release(fb->fb_lock);
+	}
+}
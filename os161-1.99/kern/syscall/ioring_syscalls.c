@@ -0,0 +1,164 @@
+/*
+ * Batched file I/O through submission and completion rings. See
+ * <kern/ioring.h>.
+ *
+ * ioring_enter copies the ring indexes in, then works through the
+ * queued operations a few at a time: copy a run of submissions in,
+ * carry each out with the ordinary system call code, and copy the
+ * run's completions out. The indexes are copied back at the end, so
+ * the whole batch costs one trap and a handful of copies.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/ioring.h>
+#include <lib.h>
+#include <copyinout.h>
+#include <syscall.h>
+
+/*
+ * Operations copied in at once. Both runs live on the kernel stack,
+ * so keep this small.
+ */
+#define IORING_BATCH	8
+
+#define IORING_MASK	(IORING_ENTRIES - 1)
+
+/*
+ * The ring indexes, which come first in struct ioring.
+ */
+struct ioring_idx {
+	unsigned ir_sqhead;
+	unsigned ir_sqtail;
+	unsigned ir_cqhead;
+	unsigned ir_cqtail;
+};
+
+/*
+ * Carry out one operation. Returns what the call would have returned
+ * to userlevel, or the negated error.
+ */
+static
+int
+ioring_do(const struct ioring_sqe *sqe)
+{
+	int result, ret;
+
+	ret = 0;
+	switch (sqe->sqe_op) {
+	case IORING_OP_NOP:
+		result = 0;
+		break;
+	case IORING_OP_READ:
+		result = sys_read(sqe->sqe_fd, sqe->sqe_buf, sqe->sqe_len,
+				  &ret);
+		break;
+	case IORING_OP_WRITE:
+		result = sys_write(sqe->sqe_fd, sqe->sqe_buf, sqe->sqe_len,
+				   &ret);
+		break;
+	case IORING_OP_PREAD:
+		result = sys_pread(sqe->sqe_fd, sqe->sqe_buf, sqe->sqe_len,
+				   sqe->sqe_off, &ret);
+		break;
+	case IORING_OP_PWRITE:
+		result = sys_pwrite(sqe->sqe_fd, sqe->sqe_buf, sqe->sqe_len,
+				    sqe->sqe_off, &ret);
+		break;
+	case IORING_OP_FSYNC:
+		result = sys_fsync(sqe->sqe_fd);
+		break;
+	case IORING_OP_CLOSE:
+		result = sys_close(sqe->sqe_fd);
+		break;
+	default:
+		result = EINVAL;
+		break;
+	}
+	return result ? -result : ret;
+}
+
+/*
+ * Carry out up to COUNT queued operations on the ring at URING, as
+ * many as there are and as there is room to complete. Returns the
+ * number taken in *RETVAL. An error is returned only if nothing was
+ * done; otherwise the caller sees a short count.
+ */
+int
+sys_ioring_enter(userptr_t uring, unsigned count, int *retval)
+{
+	struct ioring *ring = (struct ioring *)uring;
+	struct ioring_idx idx;
+	struct ioring_sqe sqes[IORING_BATCH];
+	struct ioring_cqe cqes[IORING_BATCH];
+	unsigned queued, room, sqi, cqi, run, done, i;
+	int result;
+
+	result = copyin(uring, &idx, sizeof(idx));
+	if (result) {
+		return result;
+	}
+	queued = idx.ir_sqtail - idx.ir_sqhead;
+	room = IORING_ENTRIES - (idx.ir_cqtail - idx.ir_cqhead);
+	if (queued > IORING_ENTRIES || room > IORING_ENTRIES) {
+		return EINVAL;
+	}
+	if (count > queued) {
+		count = queued;
+	}
+	if (count > room) {
+		count = room;
+	}
+
+	done = 0;
+	while (done < count) {
+		/* a run stops at the batch size and at either ring's end */
+		sqi = (idx.ir_sqhead + done) & IORING_MASK;
+		cqi = (idx.ir_cqtail + done) & IORING_MASK;
+		run = count - done;
+		if (run > IORING_BATCH) {
+			run = IORING_BATCH;
+		}
+		if (run > IORING_ENTRIES - sqi) {
+			run = IORING_ENTRIES - sqi;
+		}
+		if (run > IORING_ENTRIES - cqi) {
+			run = IORING_ENTRIES - cqi;
+		}
+
+		result = copyin((userptr_t)&ring->ir_sq[sqi], sqes,
+				run * sizeof(sqes[0]));
+		if (result) {
+			break;
+		}
+		for (i=0; i<run; i++) {
+			cqes[i].cqe_data = sqes[i].sqe_data;
+			cqes[i].cqe_res = ioring_do(&sqes[i]);
+		}
+		/* the operations have happened now, even if this fails */
+		done += run;
+		result = copyout(cqes, (userptr_t)&ring->ir_cq[cqi],
+				 run * sizeof(cqes[0]));
+		if (result) {
+			break;
+		}
+	}
+
+	if (done == 0) {
+		*retval = 0;
+		return result;
+	}
+	idx.ir_sqhead += done;
+	idx.ir_cqtail += done;
+	result = copyout(&idx.ir_sqhead, (userptr_t)&ring->ir_sqhead,
+			 sizeof(idx.ir_sqhead));
+	if (result == 0) {
+		result = copyout(&idx.ir_cqtail, (userptr_t)&ring->ir_cqtail,
+				 sizeof(idx.ir_cqtail));
+	}
+	if (result) {
+		return result;
+	}
+	*retval = done;
+	return 0;
+}
@@ -8,53 +8,44 @@
 #include <current.h>
 #include <proc.h>
 #include <synch.h>
+#include <wchan.h>
 #include <thread.h>
 #include <addrspace.h>
 #include <copyinout.h>
 #include <mips/trapframe.h>
 #include <vfs.h>
 #include <kern/fcntl.h>
+#include <limits.h>
+#include <filetable.h>
 
 /* this implementation of sys__exit does not do anything with the exit code */
 /* this needs to be fixed to get exit() and waitpid() working properly */
 
 void sys__exit(int exitcode) {
     
+    DEBUG(DB_SYSCALL,"Syscall: _exit(%d)\n",exitcode);
+    
+#if OPT_A2
+    proc_terminate(_MKWAIT_EXIT(exitcode));
+#else
     struct addrspace *as;
     struct proc *p = curproc;
-    /* for now, just include this to keep the compiler from complaining about
-     an unused variable */
-    (void)exitcode;
-    
-    DEBUG(DB_SYSCALL,"Syscall: _exit(%d)\n",exitcode);
     
     KASSERT(curproc->p_addrspace != NULL);
     as_deactivate();
-    /*
-     * clear p_addrspace before calling as_destroy. Otherwise if
-     * as_destroy sleeps (which is quite possible) when we
-     * come back we'll be calling as_activate on a
-     * half-destroyed address space. This tends to be
-     * messily fatal.
-     */
     as = curproc_setas(NULL);
     as_destroy(as);
     
     /* detach this thread from its process */
     /* note: curproc cannot be used after this call */
     proc_remthread(curthread);
-    #if OPT_A2
-    DEBUG(DB_EXEC, "start sys_exit\n");
-    lock_acquire(proc_lock);
-    proc_exit(p, exitcode);
-    lock_release(proc_lock);
-    DEBUG(DB_EXEC, "finish sys_exit\n");
-    #endif // OPT_A2a
+    
     /* if this is the last user process in the system, proc_destroy()
      will wake up the kernel menu thread */
-    //proc_destroy(p);
+    proc_destroy(p);
     
     thread_exit();
+#endif // OPT_A2
     /* thread_exit() does not return, so we should never get here */
     panic("return from thread_exit in sys_exit\n");
 }
@@ -75,6 +66,37 @@ sys_getpid(pid_t *retval)
     return(0);
 }
 
+#if OPT_A2
+/*
+ * Find what waitpid(PID) should collect from PARENT: an exited child
+ * in *ZOMBIE, or NULL if the child(ren) asked for are still running.
+ * Fails with ECHILD if PID isn't one of PARENT's children. PARENT's
+ * p_lock must be held.
+ */
+static int waitpid_find(struct proc *parent, pid_t pid, struct proc **zombie){
+    struct proc *child;
+    
+    KASSERT(spinlock_do_i_hold(&parent->p_lock));
+    *zombie = NULL;
+    if(parent->p_children == NULL){
+        return ECHILD;
+    }
+    for(child = parent->p_children; child != NULL; child = child->p_sibling){
+        if(pid != WAIT_ANY && child->curpid != pid){
+            continue;
+        }
+        if(child->state == 0){
+            *zombie = child;
+            return 0;
+        }
+        if(pid != WAIT_ANY){
+            return 0;
+        }
+    }
+    return pid == WAIT_ANY ? 0 : ECHILD;
+}
+#endif // OPT_A2
+
 /* stub handler for waitpid() system call                */
 
 int
@@ -86,10 +108,70 @@ sys_waitpid(pid_t pid,
 #if OPT_A2
     int exitstatus = 0;
     int result = 0;
+    struct proc *parent = curproc;
+    struct proc *child = NULL;
+    pid_t childpid = 0;
+    
+    if ((options & ~WNOHANG) != 0) {
+        return(EINVAL);
+    }
+    DEBUG(DB_EXEC, "start sys_waitpid\n");
+    /*
+     * Our children and their states are under our own p_lock, so
+     * waiting doesn't touch any lock shared with unrelated processes.
+     * A child's exit sets its state holding our p_lock, so holding
+     * the wchan across dropping it means the wakeup can't slip in
+     * between the check and the sleep. Every child's exit wakes the
+     * same channel, so a parent waiting for any of many children
+     * sleeps once per exit.
+     */
+    spinlock_acquire(&parent->p_lock);
+    while(1){
+        result = waitpid_find(parent, pid, &child);
+        if(result || child != NULL || (options & WNOHANG)){
+            break;
+        }
+        wchan_lock(parent->p_childwait);
+        spinlock_release(&parent->p_lock);
+        wchan_sleep(parent->p_childwait);
+        spinlock_acquire(&parent->p_lock);
+    }
+    if(child != NULL){
+        /* once off our list it is ours alone to destroy */
+        spinlock_acquire(&child->p_lock);
+        proc_unlink(child);
+        spinlock_release(&child->p_lock);
+        exitstatus = child->exitcode;
+        childpid = child->curpid;
+    }
+    spinlock_release(&parent->p_lock);
+    
+    if(result){
+        if(pid != WAIT_ANY && !proc_exists(pid)){
+            result = ESRCH;
+        }
+        return result;
+    }
+    if(child == NULL){
+        /* WNOHANG, and nothing has exited yet */
+        *retval = 0;
+        return 0;
+    }
+    remove_proctree(child);
+    proc_destroy(child);
+    DEBUG(DB_EXEC, "finish sys_waitpid\n");
+    
+    if(status != NULL){
+        result = copyout((void *)&exitstatus,status,sizeof(int));
+        if (result) {
+            return(result);
+        }
+    }
+    *retval = childpid;
+    return(0);
 #else
     int exitstatus;
     int result;
-#endif // OPT_A2a
     
     /* this is just a stub implementation that always reports an
      exit status of 0, regardless of the actual exit status of
@@ -103,37 +185,14 @@ sys_waitpid(pid_t pid,
         return(EINVAL);
     }
     /* for now, just pretend the exitstatus is 0 */
-    #if OPT_A2
-    DEBUG(DB_EXEC, "start sys_waitpid\n");
-    lock_acquire(proc_lock);
-    struct proc *parent = curproc;
-    struct proc *children = array_get(proctree, pid);
-    
-    if(children == NULL){
-        result = ESRCH;
-    } else if(children->parent_pid != parent->curpid){
-        result = ECHILD;
-    }
-    
-    if(result){
-        lock_release(proc_lock);
-        return result;
-    }
-    
-    while(children->state == 1){
-        cv_wait(children->wait, proc_lock);
-    }
-    exitstatus = children->exitcode;
-    lock_release(proc_lock);
-    DEBUG(DB_EXEC, "finish sys_waitpid\n");
-    #endif // OPT_A2a
-    
+    exitstatus = 0;
     result = copyout((void *)&exitstatus,status,sizeof(int));
     if (result) {
         return(result);
     }
     *retval = pid;
     return(0);
+#endif // OPT_A2
 }
 
 #if OPT_A2
@@ -146,14 +205,14 @@ int sys_fork(struct trapframe *tf, pid_t *retval){
     }
     struct addrspace *c_addr = kmalloc(sizeof(struct addrspace));
     if(c_addr == NULL){
-        proc_destroy(p);
+        proc_discard(p);
         return ENOMEM;
     }
     struct trapframe *c_trap = kmalloc(sizeof(struct trapframe));
     if(c_trap == NULL){
         kfree(c_trap);
         as_destroy(c_addr);
-        proc_destroy(p);
+        proc_discard(p);
         return ENOMEM;
     }
     
@@ -161,80 +220,527 @@ int sys_fork(struct trapframe *tf, pid_t *retval){
     
     if(result){
         kfree(c_addr);
-        proc_destroy(p);
+        proc_discard(p);
         return result;
     }
     
     p->p_addrspace = c_addr;
     memcpy(c_trap, tf, sizeof(struct trapframe));
     
-    result = thread_fork("check_fork", p, enter_forked_process, c_trap, 1);
+    /* the child's only thread carries on in the forking thread's stack slot */
+    unsigned tid = curthread->t_utid;
+    p->p_uthreads[0].ut_state = UT_FREE;
+    p->p_uthreads[tid].ut_state = UT_RUNNING;
+    
+    result = thread_fork("check_fork", p, enter_forked_process, c_trap, tid);
     if(result){
         kfree(c_trap);
+        proc_discard(p);
         return result;
     }
     *retval = p->curpid;
     DEBUG(DB_EXEC, "finish sys_fork\n");
     return 0;
 }
+
+/*
+ * vfork: like fork, but the child runs in our address space instead
+ * of a copy, and this thread sleeps until the child has execv'd or
+ * exited, so the two are never running in it at once. The child may
+ * scribble on our stack below where vfork was called from, so it
+ * should do nothing but execv or _exit.
+ */
+int sys_vfork(struct trapframe *tf, pid_t *retval){
+    struct semaphore *sem;
+    struct trapframe *c_trap;
+    struct proc *p;
+    pid_t pid;
+    int result;
+    
+    p = proc_create_runprogram("system_vfork");
+    if(p == NULL){
+        return ENOMEM;
+    }
+    sem = sem_create("vfork", 0);
+    c_trap = kmalloc(sizeof(struct trapframe));
+    if(sem == NULL || c_trap == NULL){
+        if(sem != NULL){
+            sem_destroy(sem);
+        }
+        kfree(c_trap);
+        proc_discard(p);
+        return ENOMEM;
+    }
+    memcpy(c_trap, tf, sizeof(struct trapframe));
+    p->p_addrspace = curproc_getas();
+    p->p_vforksem = sem;
+    
+    /* as in fork, the child's thread keeps our stack slot */
+    unsigned tid = curthread->t_utid;
+    p->p_uthreads[0].ut_state = UT_FREE;
+    p->p_uthreads[tid].ut_state = UT_RUNNING;
+    
+    pid = p->curpid;
+    result = thread_fork("check_vfork", p, enter_forked_process, c_trap, tid);
+    if(result){
+        kfree(c_trap);
+        p->p_addrspace = NULL;
+        p->p_vforksem = NULL;
+        sem_destroy(sem);
+        proc_discard(p);
+        return result;
+    }
+    
+    P(sem);
+    sem_destroy(sem);
+    *retval = pid;
+    return 0;
+}
 #endif // OPT_A2a
 
 #if OPT_A2
+/*
+ * Copy the argument vector UARGS in from userland, into BUF (ARG_MAX
+ * bytes), laid out as it will be on the new stack: the argv pointer
+ * array, NULL-terminated, followed by the strings. Until the stack
+ * address is known, the pointers hold offsets from the start of BUF.
+ * Returns argc in *ARGC and the size of the block, padded to keep
+ * the stack aligned, in *LEN.
+ *
+ * The pointer array is copied a page at a time (a page is either
+ * all readable or not, so this can't fault past the NULL), and each
+ * string goes straight to its final place with one copyinstr.
+ */
+static int execv_copyinargs(userptr_t uargs, char *buf, int *argc, size_t *len){
+    userptr_t *argv = (userptr_t *)buf;
+    vaddr_t uaddr = (vaddr_t)uargs;
+    size_t max = ARG_MAX / sizeof(userptr_t);
+    size_t n = 0, chunk, off, got;
+    int result;
+    
+    if(uaddr % sizeof(userptr_t) != 0){
+        return EFAULT;
+    }
+    while(1){
+        if(n == max){
+            return E2BIG;
+        }
+        chunk = (PAGE_SIZE - uaddr % PAGE_SIZE) / sizeof(userptr_t);
+        if(chunk > max - n){
+            chunk = max - n;
+        }
+        result = copyin((const_userptr_t)uaddr, &argv[n], chunk * sizeof(userptr_t));
+        if(result){
+            return result;
+        }
+        for(; chunk > 0 && argv[n] != NULL; chunk--){
+            n++;
+        }
+        if(chunk > 0){
+            break;
+        }
+        uaddr += PAGE_SIZE - uaddr % PAGE_SIZE;
+    }
+    
+    off = (n + 1) * sizeof(userptr_t);
+    for(size_t i = 0; i < n; i++){
+        result = copyinstr((const_userptr_t)argv[i], buf + off, ARG_MAX - off, &got);
+        if(result){
+            return result == ENAMETOOLONG ? E2BIG : result;
+        }
+        argv[i] = (userptr_t)off;
+        off += got;
+    }
+    
+    *len = ROUNDUP(off, 8);
+    if(*len > ARG_MAX){
+        return E2BIG;
+    }
+    bzero(buf + off, *len - off);
+    *argc = n;
+    return 0;
+}
+
+/*
+ * Push an argument block made by execv_copyinargs onto the stack of
+ * the current address space, just below *STACKPTR, pointing argv at
+ * where the strings land. *STACKPTR is left pointing at argv.
+ */
+static int execv_copyoutargs(char *buf, int argc, size_t len, vaddr_t *stackptr){
+    userptr_t *argv = (userptr_t *)buf;
+    
+    *stackptr -= len;
+    for(int i = 0; i < argc; i++){
+        argv[i] = (userptr_t)(*stackptr + (vaddr_t)argv[i]);
+    }
+    return copyout(buf, (userptr_t)*stackptr, len);
+}
+
 int sys_execv(char *program, char **args){
-    int total, result;
-    vaddr_t start, offset, argsPtr, stackptr, entrypoint;
+    int argc, result;
+    size_t arglen;
+    vaddr_t stackptr, entrypoint;
     struct vnode *change;
-    struct addrspace *oldAddr;
-    for(total = 0; args[total] != NULL; total++);
+    struct addrspace *oldAddr, *newAddr;
+    char *path, *argbuf;
     
-    int totalArgs[total];
-    char *kernArgs[total];
-    for(int i = 0; i < total; i++){
-        totalArgs[i] = strlen(args[i]);
-        kernArgs[i] = kmalloc(sizeof(char)*totalArgs[i]+1);
-        copyin((const_userptr_t)args[i], kernArgs[i], (totalArgs[i]+1)*sizeof(char));
+    path = kmalloc(PATH_MAX);
+    argbuf = kmalloc(ARG_MAX);
+    if(path == NULL || argbuf == NULL){
+        kfree(path);
+        kfree(argbuf);
+        return ENOMEM;
+    }
+    result = copyinstr((const_userptr_t)program, path, PATH_MAX, NULL);
+    if(result == 0){
+        result = execv_copyinargs((userptr_t)args, argbuf, &argc, &arglen);
+    }
+    if(result == 0){
+        /* vfs_open may scribble on the path */
+        result = vfs_open(path, O_RDONLY, 0, &change);
+    }
+    kfree(path);
+    if(result){
+        kfree(argbuf);
+        return result;
     }
     
-    result = vfs_open(program, O_RDONLY, 0, &change);
-    if(result) return result;
-    as_deactivate();
-    oldAddr = curproc_setas(NULL);
-    as_destroy(oldAddr);
+    /*
+     * The new image starts with just us. We stay in our old slot until
+     * it has loaded, since a failed load goes back to the old stack.
+     */
+    result = proc_singlethread(false);
+    if(result){
+        vfs_close(change);
+        kfree(argbuf);
+        return result;
+    }
     
-    struct addrspace *newAddr = as_create();
+    /* keep the old image until the new one has loaded */
+    newAddr = as_create();
     if(newAddr == NULL){
         vfs_close(change);
+        kfree(argbuf);
         return ENOMEM;
     }
-    curproc_setas(newAddr);
+    oldAddr = curproc_setas(newAddr);
     as_activate();
     result = load_elf(change, &entrypoint);
-    if(result) {
-        vfs_close(change);
+    vfs_close(change);
+    if(result == 0){
+        result = as_define_stack(newAddr, &stackptr);
+    }
+    if(result){
+        curproc_setas(oldAddr);
+        as_activate();
+        as_destroy(newAddr);
+        kfree(argbuf);
         return result;
     }
-    vfs_close(change);
-    result = as_define_stack(newAddr, &stackptr);
-    if(result) return result;
-    
-    argsPtr = stackptr;
-    for(int i = 0; i < total+1; i++){
-        argsPtr -= 4;
-    }
-    start = offset = argsPtr;
-    copyout(NULL, (userptr_t)(stackptr-4), 4);
-    for(int i = 0; i < total; i++){
-        argsPtr -= sizeof(char)*(strlen(kernArgs[i])+1);
-        copyout(kernArgs[i], (userptr_t)argsPtr, sizeof(char)*(strlen(kernArgs[i])+1));
-        copyout(&argsPtr, (userptr_t)offset, sizeof(char*));
-        offset += 4;
-        kfree(kernArgs[i]);
-    }
-    while (argsPtr%8 != 0) {
-        argsPtr--;
-    }
-    enter_new_process(total, (userptr_t)start, (vaddr_t)argsPtr, entrypoint);
+    proc_becomemain();
+    /* a vfork child's old image was its parent's, and goes back to it */
+    if(!proc_vforkdone(curproc)){
+        as_destroy(oldAddr);
+    }
+    
+    result = execv_copyoutargs(argbuf, argc, arglen, &stackptr);
+    kfree(argbuf);
+    if(result){
+        /* the old image is gone; nothing to go back to */
+        sys__exit(-1);
+    }
+    enter_new_process(argc, (userptr_t)stackptr, stackptr, entrypoint);
     panic("sys_execv returned");
     return EINVAL;
 }
+
+/*
+ * spawn: make a child running PROGRAM with ARGS, as fork+execv would,
+ * but without copying our address space only to throw it away. The
+ * child's thread loads the program into a fresh address space and
+ * reports back before going to user mode, so load errors come back
+ * from spawn itself.
+ *
+ * The child gets a copy of our descriptor table, as with fork, or
+ * with SPAWN_STDIO in FLAGS just standard input, output and error.
+ */
+struct spawn_args {
+    struct vnode *sa_vnode;
+    char *sa_argbuf;
+    int sa_argc;
+    size_t sa_arglen;
+    struct semaphore *sa_done;
+    int sa_result;
+};
+
+static void spawn_enter(void *data1, unsigned long data2){
+    struct spawn_args *sa = data1;
+    struct addrspace *as;
+    vaddr_t stackptr, entrypoint;
+    int argc, result;
+    
+    (void)data2;
+    as = as_create();
+    if(as == NULL){
+        result = ENOMEM;
+    } else {
+        curproc_setas(as);
+        as_activate();
+        result = load_elf(sa->sa_vnode, &entrypoint);
+    }
+    if(result == 0){
+        result = as_define_stack(as, &stackptr);
+    }
+    if(result == 0){
+        result = execv_copyoutargs(sa->sa_argbuf, sa->sa_argc, sa->sa_arglen, &stackptr);
+    }
+    
+    /* sa lives on the parent's stack; done with it after this */
+    argc = sa->sa_argc;
+    sa->sa_result = result;
+    V(sa->sa_done);
+    
+    if(result == 0){
+        enter_new_process(argc, (userptr_t)stackptr, stackptr, entrypoint);
+        panic("spawn: enter_new_process returned");
+    }
+    /* exit quietly; the parent collects us */
+    as_deactivate();
+    as = curproc_setas(NULL);
+    if(as != NULL){
+        as_destroy(as);
+    }
+    struct proc *p = curproc;
+    proc_remthread(curthread);
+    proc_exit(p, _MKWAIT_EXIT(0));
+    thread_exit();
+}
+
+int sys_spawn(userptr_t program, userptr_t args, int flags, pid_t *retval){
+    struct spawn_args sa;
+    struct proc *p;
+    struct openfile *of;
+    char *path;
+    pid_t pid, junk;
+    int fd, result;
+    
+    if(flags & ~SPAWN_STDIO){
+        return EINVAL;
+    }
+    path = kmalloc(PATH_MAX);
+    sa.sa_argbuf = kmalloc(ARG_MAX);
+    sa.sa_done = sem_create("spawn", 0);
+    if(path == NULL || sa.sa_argbuf == NULL || sa.sa_done == NULL){
+        result = ENOMEM;
+        goto out;
+    }
+    result = copyinstr(program, path, PATH_MAX, NULL);
+    if(result){
+        goto out;
+    }
+    result = execv_copyinargs(args, sa.sa_argbuf, &sa.sa_argc, &sa.sa_arglen);
+    if(result){
+        goto out;
+    }
+    
+    p = proc_create_runprogram(path);
+    if(p == NULL){
+        result = ENOMEM;
+        goto out;
+    }
+    if(flags & SPAWN_STDIO){
+        for(fd = STDERR_FILENO + 1; fd < OPEN_MAX; fd++){
+            if(filetable_remove(p->p_filetable, fd, &of) == 0){
+                openfile_decref(of);
+            }
+        }
+    }
+    /* vfs_open may scribble on the path, so the name is taken first */
+    result = vfs_open(path, O_RDONLY, 0, &sa.sa_vnode);
+    if(result){
+        proc_discard(p);
+        goto out;
+    }
+    pid = p->curpid;
+    result = thread_fork("spawn", p, spawn_enter, &sa, 0);
+    if(result){
+        vfs_close(sa.sa_vnode);
+        proc_discard(p);
+        goto out;
+    }
+    
+    P(sa.sa_done);
+    vfs_close(sa.sa_vnode);
+    result = sa.sa_result;
+    if(result){
+        /* it has exited, or is about to; reap it */
+        sys_waitpid(pid, NULL, 0, &junk);
+        goto out;
+    }
+    *retval = pid;
+    
+out:
+    if(sa.sa_done != NULL){
+        sem_destroy(sa.sa_done);
+    }
+    kfree(sa.sa_argbuf);
+    kfree(path);
+    return result;
+}
 #endif // OPT_A2b
+
+#if OPT_A2
+struct uthread_start {
+    vaddr_t us_entry;
+    userptr_t us_arg0;
+    userptr_t us_arg1;
+    vaddr_t us_stack;
+};
+
+/* first thing a new user thread runs, in the kernel */
+static void uthread_start(void *data, unsigned long tid){
+    struct uthread_start us = *(struct uthread_start *)data;
+    kfree(data);
+    
+    curthread->t_utid = tid;
+    as_activate();
+    /* the process may have started going away while we were being set up */
+    proc_checkexit();
+    /* enter_new_process passes its first two arguments in a0 and a1 */
+    enter_new_process((int)us.us_arg0, us.us_arg1, us.us_stack, us.us_entry);
+    panic("enter_new_process returned\n");
+}
+
+int sys___thread_create(userptr_t entry, userptr_t arg0, userptr_t arg1,
+                        int *retval){
+    struct proc *p = curproc;
+    struct addrspace *as = curproc_getas();
+    struct uthread_start *us = NULL;
+    unsigned tid;
+    int result;
+    
+    spinlock_acquire(&p->p_lock);
+    if(p->p_exiting){
+        spinlock_release(&p->p_lock);
+        return EINTR;
+    }
+    for(tid = 1; tid < AS_NTHREADSTACKS; tid++){
+        if(p->p_uthreads[tid].ut_state == UT_FREE){
+            break;
+        }
+    }
+    if(tid == AS_NTHREADSTACKS){
+        spinlock_release(&p->p_lock);
+        return EAGAIN;
+    }
+    /* counts as running from here on, so an exiting process waits for it */
+    p->p_uthreads[tid].ut_state = UT_RUNNING;
+    spinlock_release(&p->p_lock);
+    
+    us = kmalloc(sizeof(*us));
+    if(us == NULL){
+        result = ENOMEM;
+        goto fail;
+    }
+    result = as_define_threadstack(as, tid, &us->us_stack);
+    if(result){
+        goto fail;
+    }
+    us->us_entry = (vaddr_t)entry;
+    us->us_arg0 = arg0;
+    us->us_arg1 = arg1;
+    
+    result = thread_fork(p->p_name, p, uthread_start, us, tid);
+    if(result){
+        as_remove_threadstack(as, tid);
+        goto fail;
+    }
+    *retval = tid;
+    return 0;
+    
+fail:
+    kfree(us);
+    spinlock_acquire(&p->p_lock);
+    p->p_uthreads[tid].ut_state = UT_FREE;
+    wchan_wakeall(p->p_threadwait);
+    spinlock_release(&p->p_lock);
+    return result;
+}
+
+void sys_thread_exit(int exitcode){
+    struct proc *p = curproc;
+    unsigned self = curthread->t_utid;
+    unsigned i;
+    bool last = true;
+    
+    /* decide under the lock, so two threads leaving together agree */
+    spinlock_acquire(&p->p_lock);
+    for(i = 0; i < AS_NTHREADSTACKS; i++){
+        if(i != self && p->p_uthreads[i].ut_state == UT_RUNNING){
+            last = false;
+            break;
+        }
+    }
+    if(!last){
+        p->p_uthreads[self].ut_state = UT_EXITING;
+    }
+    spinlock_release(&p->p_lock);
+    
+    if(last){
+        sys__exit(exitcode);
+    }
+    proc_threadleave(exitcode);
+}
+
+int sys_thread_join(int tid, userptr_t status){
+    struct proc *p = curproc;
+    int exitcode;
+    
+    if(tid < 0 || tid >= AS_NTHREADSTACKS){
+        return ESRCH;
+    }
+    if((unsigned)tid == curthread->t_utid){
+        return EINVAL;
+    }
+    
+    spinlock_acquire(&p->p_lock);
+    while(p->p_uthreads[tid].ut_state == UT_RUNNING ||
+          p->p_uthreads[tid].ut_state == UT_EXITING){
+        if(p->p_exiting){
+            spinlock_release(&p->p_lock);
+            return EINTR;
+        }
+        wchan_lock(p->p_threadwait);
+        spinlock_release(&p->p_lock);
+        wchan_sleep(p->p_threadwait);
+        spinlock_acquire(&p->p_lock);
+    }
+    if(p->p_uthreads[tid].ut_state != UT_EXITED){
+        /* never created, or someone already joined it */
+        spinlock_release(&p->p_lock);
+        return ESRCH;
+    }
+    exitcode = p->p_uthreads[tid].ut_exitcode;
+    p->p_uthreads[tid].ut_state = UT_FREE;
+    spinlock_release(&p->p_lock);
+    
+    if(status != NULL){
+        return copyout(&exitcode, status, sizeof(int));
+    }
+    return 0;
+}
+
+int sys_thread_setaffinity(uint32_t mask, userptr_t oldmask){
+    uint32_t old = curthread->t_affinity;
+    int result;
+    
+    result = thread_set_affinity(mask);
+    if(result){
+        return result;
+    }
+    if(oldmask != NULL){
+        return copyout(&old, oldmask, sizeof(old));
+    }
+    return 0;
+}
+#endif // OPT_A2
@@ -28,7 +28,12 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
+#include <kern/time.h>
+#include <kern/resource.h>
 #include <clock.h>
+#include <current.h>
+#include <proc.h>
 #include <copyinout.h>
 #include <syscall.h>
 
@@ -56,3 +61,54 @@ sys___time(userptr_t user_seconds_ptr, userptr_t user_nanoseconds_ptr)
 
 	return 0;
 }
+
+/*
+ * Sleep for the interval in REQ. There are no signals to interrupt
+ * the sleep, so the time remaining stored in REM is always zero.
+ */
+int
+sys_nanosleep(const_userptr_t user_req, userptr_t user_rem)
+{
+	struct timespec req, rem;
+	uint64_t deadline;
+	int result;
+
+	result = copyin(user_req, &req, sizeof(req));
+	if (result) {
+		return result;
+	}
+	if (req.tv_sec < 0 || req.tv_nsec < 0 || req.tv_nsec >= 1000000000) {
+		return EINVAL;
+	}
+
+	deadline = gettime_ns() + (uint64_t)req.tv_sec * 1000000000
+		+ req.tv_nsec;
+	thread_sleep_until(deadline);
+
+	if (user_rem != NULL) {
+		rem.tv_sec = 0;
+		rem.tv_nsec = 0;
+		result = copyout(&rem, user_rem, sizeof(rem));
+		if (result) {
+			return result;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Resource usage of the current process: cpu time, time spent waiting
+ * for a cpu, and context switches (see proc_getrusage). Children's
+ * usage isn't collected, so RUSAGE_CHILDREN is not supported.
+ */
+int
+sys_getrusage(int who, userptr_t user_usage)
+{
+	struct rusage ru;
+
+	if (who != RUSAGE_SELF) {
+		return EINVAL;
+	}
+	proc_getrusage(curproc, &ru);
+	return copyout(&ru, user_usage, sizeof(ru));
+}
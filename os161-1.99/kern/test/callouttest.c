@@ -0,0 +1,111 @@
+/*
+ * Callout and timed sleep test code.
+ */
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <callout.h>
+#include <thread.h>
+#include <synch.h>
+#include <test.h>
+
+#define NSLEEPERS	16
+#define MAXSLEEPNS	500000000	/* half a second */
+
+static struct semaphore *donesem;
+static volatile uint64_t maxlate;
+static volatile unsigned early;
+
+static
+void
+sleeper(void *junk, unsigned long num)
+{
+	uint64_t deadline, now;
+
+	(void)junk;
+
+	deadline = gettime_ns() + random() % MAXSLEEPNS;
+	thread_sleep_until(deadline);
+	now = gettime_ns();
+
+	if (now < deadline) {
+		kprintf("sleeper %lu woke %llu ns early\n", num,
+			(unsigned long long)(deadline - now));
+		early++;
+	}
+	else if (now - deadline > maxlate) {
+		/* racy, but only a statistic */
+		maxlate = now - deadline;
+	}
+	V(donesem);
+}
+
+static
+void
+countfired(void *arg)
+{
+	volatile unsigned *count = arg;
+
+	(*count)++;
+}
+
+int
+callouttest(int nargs, char **args)
+{
+	struct callout co;
+	volatile unsigned fired = 0;
+	unsigned long i;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting callout test...\n");
+
+	donesem = sem_create("callouttest", 0);
+	if (donesem == NULL) {
+		panic("callouttest: sem_create failed\n");
+	}
+	maxlate = 0;
+	early = 0;
+
+	for (i=0; i<NSLEEPERS; i++) {
+		result = thread_fork("sleeper", NULL, sleeper, NULL, i);
+		if (result) {
+			panic("callouttest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NSLEEPERS; i++) {
+		P(donesem);
+	}
+	kprintf("%d sleepers, %u woke early, latest woke %llu ns late\n",
+		NSLEEPERS, early, (unsigned long long)maxlate);
+
+	/* A cancelled callout must not run. */
+	callout_init(&co, countfired, (void *)&fired);
+	callout_schedule(&co, gettime_ns() + 100000000);
+	if (!callout_stop(&co)) {
+		panic("callouttest: callout_stop missed a pending callout\n");
+	}
+	clocksleep(1);
+	if (fired != 0) {
+		panic("callouttest: cancelled callout ran\n");
+	}
+
+	/* An uncancelled one must run exactly once. */
+	callout_schedule(&co, gettime_ns() + 10000000);
+	clocksleep(1);
+	if (fired != 1) {
+		panic("callouttest: callout ran %u times\n", fired);
+	}
+	if (callout_stop(&co)) {
+		panic("callouttest: fired callout still pending\n");
+	}
+
+	sem_destroy(donesem);
+	donesem = NULL;
+
+	kprintf("Callout test done.\n");
+	return 0;
+}
@@ -35,6 +35,7 @@
 #include <lib.h>
 #include <clock.h>
 #include <thread.h>
+#include <current.h>
 #include <synch.h>
 #include <test.h>
 
@@ -347,3 +348,283 @@ cvtest(int nargs, char **args)
 
 	return 0;
 }
+
+#define NRWLOOPS      40
+#define NRWWRITERS    4
+
+static struct rwlock *testrwlock;
+static volatile unsigned rwtest_readers;
+static volatile unsigned rwtest_maxreaders;
+static volatile unsigned rwtest_writers;
+static volatile bool rwtest_failed;
+static struct spinlock rwtest_spin;
+
+static
+void
+rwtest_check(unsigned long num, bool writer)
+{
+	spinlock_acquire(&rwtest_spin);
+	if (rwtest_writers > 1 || (rwtest_writers > 0 && rwtest_readers > 0)) {
+		kprintf("thread %lu (%s): %u writers, %u readers inside\n",
+			num, writer ? "writer" : "reader",
+			rwtest_writers, rwtest_readers);
+		rwtest_failed = true;
+	}
+	spinlock_release(&rwtest_spin);
+
+	if (testval2 != testval1*testval1 || testval3 != testval1%3) {
+		kprintf("thread %lu (%s): Mismatch on testvals\n",
+			num, writer ? "writer" : "reader");
+		rwtest_failed = true;
+	}
+}
+
+static
+void
+rwtestthread(void *junk, unsigned long num)
+{
+	bool writer = (num % (NTHREADS/NRWWRITERS)) == 0;
+	int i;
+	volatile int j;
+	(void)junk;
+
+	for (i=0; i<NRWLOOPS; i++) {
+		if (writer) {
+			rwlock_acquire_write(testrwlock);
+			spinlock_acquire(&rwtest_spin);
+			rwtest_writers++;
+			spinlock_release(&rwtest_spin);
+
+			rwtest_check(num, true);
+			testval1 = num;
+			for (j=0; j<100; j++);
+			testval2 = num*num;
+			testval3 = num%3;
+			rwtest_check(num, true);
+
+			spinlock_acquire(&rwtest_spin);
+			rwtest_writers--;
+			spinlock_release(&rwtest_spin);
+			rwlock_release_write(testrwlock);
+		}
+		else {
+			rwlock_acquire_read(testrwlock);
+			spinlock_acquire(&rwtest_spin);
+			rwtest_readers++;
+			if (rwtest_readers > rwtest_maxreaders) {
+				rwtest_maxreaders = rwtest_readers;
+			}
+			spinlock_release(&rwtest_spin);
+
+			rwtest_check(num, false);
+			/* give other readers a chance to come in */
+			thread_yield();
+			rwtest_check(num, false);
+
+			spinlock_acquire(&rwtest_spin);
+			rwtest_readers--;
+			spinlock_release(&rwtest_spin);
+			rwlock_release_read(testrwlock);
+		}
+	}
+	V(donesem);
+#ifdef UW
+  thread_exit();
+#endif
+}
+
+int
+rwtest(int nargs, char **args)
+{
+	int i, result;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	testrwlock = rwlock_create("testrwlock");
+	if (testrwlock == NULL) {
+		panic("rwtest: rwlock_create failed\n");
+	}
+	spinlock_init(&rwtest_spin);
+	rwtest_readers = rwtest_maxreaders = rwtest_writers = 0;
+	rwtest_failed = false;
+	testval1 = testval2 = testval3 = 0;
+
+	kprintf("Starting rwlock test...\n");
+
+	for (i=0; i<NTHREADS; i++) {
+		result = thread_fork("rwtest", NULL, rwtestthread, NULL, i);
+		if (result) {
+			panic("rwtest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NTHREADS; i++) {
+		P(donesem);
+	}
+
+	rwlock_destroy(testrwlock);
+	testrwlock = NULL;
+	spinlock_cleanup(&rwtest_spin);
+#ifdef UW
+  cleanitems();
+#endif
+	kprintf("At most %u readers held the lock at once\n",
+		rwtest_maxreaders);
+	if (rwtest_failed) {
+		kprintf("Test failed\n");
+	}
+	kprintf("Rwlock test done.\n");
+
+	return 0;
+}
+
+/*
+ * Priority inversion test.
+ *
+ * A low-priority thread takes a lock; a high-priority thread then
+ * wants the same lock while several medium-priority threads keep the
+ * cpu busy. Without priority inheritance the low-priority holder
+ * never gets to run until the medium threads are done, so the
+ * high-priority thread waits for all of them. With it, the holder is
+ * boosted, finishes its critical section, and the high-priority
+ * thread gets in while the medium threads are still going.
+ *
+ * Run this with one cpu; with more, the medium threads may simply
+ * not be competing with the lock holder.
+ */
+
+#define NPIMEDIUM     4
+#define NPILOOPS      200
+#define NPIHOLDLOOPS  20
+
+static struct lock *pilock;
+static struct semaphore *piheld;
+static volatile unsigned pi_mediumdone;
+static volatile unsigned pi_mediumdone_at_acquire;
+
+static
+void
+pilowthread(void *junk, unsigned long num)
+{
+	int i;
+	(void)junk;
+	(void)num;
+
+	thread_set_priority(THREAD_PRI_MIN);
+	lock_acquire(pilock);
+	V(piheld);
+	for (i=0; i<NPIHOLDLOOPS; i++) {
+		/* only higher-or-equal priority threads can take over */
+		thread_yield();
+	}
+	lock_release(pilock);
+	V(donesem);
+#ifdef UW
+  thread_exit();
+#endif
+}
+
+static
+void
+pimediumthread(void *junk, unsigned long num)
+{
+	int i;
+	(void)junk;
+	(void)num;
+
+	thread_set_priority(THREAD_PRI_DEFAULT);
+	for (i=0; i<NPILOOPS; i++) {
+		thread_yield();
+	}
+	pi_mediumdone++;
+	V(donesem);
+#ifdef UW
+  thread_exit();
+#endif
+}
+
+static
+void
+pihighthread(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	thread_set_priority(THREAD_PRI_MAX);
+	lock_acquire(pilock);
+	pi_mediumdone_at_acquire = pi_mediumdone;
+	lock_release(pilock);
+	V(donesem);
+#ifdef UW
+  thread_exit();
+#endif
+}
+
+int
+pitest(int nargs, char **args)
+{
+	int i, result;
+	int oldpri;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	pilock = lock_create("pilock");
+	piheld = sem_create("piheld", 0);
+	if (pilock == NULL || piheld == NULL) {
+		panic("pitest: create failed\n");
+	}
+	pi_mediumdone = 0;
+	pi_mediumdone_at_acquire = 0;
+
+	kprintf("Starting priority inheritance test...\n");
+
+	/* stay ahead of the medium threads while setting things up */
+	oldpri = curthread->t_basepri;
+	thread_set_priority(THREAD_PRI_MAX);
+
+	result = thread_fork("pitest-low", NULL, pilowthread, NULL, 0);
+	if (result) {
+		panic("pitest: thread_fork failed: %s\n", strerror(result));
+	}
+	P(piheld);
+
+	for (i=0; i<NPIMEDIUM; i++) {
+		result = thread_fork("pitest-medium", NULL, pimediumthread,
+				     NULL, i);
+		if (result) {
+			panic("pitest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	result = thread_fork("pitest-high", NULL, pihighthread, NULL, 0);
+	if (result) {
+		panic("pitest: thread_fork failed: %s\n", strerror(result));
+	}
+
+	thread_set_priority(oldpri);
+	for (i=0; i<NPIMEDIUM+2; i++) {
+		P(donesem);
+	}
+
+	kprintf("High-priority thread got the lock after %u of %u "
+		"medium threads finished\n",
+		pi_mediumdone_at_acquire, NPIMEDIUM);
+	if (pi_mediumdone_at_acquire == NPIMEDIUM) {
+		kprintf("Priority inversion: test failed\n");
+	}
+
+	lock_destroy(pilock);
+	sem_destroy(piheld);
+	pilock = NULL;
+	piheld = NULL;
+#ifdef UW
+  cleanitems();
+#endif
+	kprintf("Priority inheritance test done.\n");
+
+	return 0;
+}
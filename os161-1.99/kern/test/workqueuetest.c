@@ -0,0 +1,119 @@
+/*
+ * Workqueue test code.
+ */
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <spinlock.h>
+#include <thread.h>
+#include <synch.h>
+#include <workqueue.h>
+#include <test.h>
+
+#define NQUEUERS	8
+#define NITEMS		32	/* per queuer */
+
+static struct semaphore *donesem;
+static struct spinlock countlock = SPINLOCK_INITIALIZER;
+static unsigned count;
+static struct work items[NQUEUERS][NITEMS];
+
+static
+void
+countwork(void *arg)
+{
+	unsigned long num = (unsigned long)arg;
+
+	/* work functions may sleep */
+	if (num % NITEMS == 0) {
+		thread_sleep_until(gettime_ns() + 1000000);
+	}
+	spinlock_acquire(&countlock);
+	count++;
+	spinlock_release(&countlock);
+}
+
+static
+void
+queuer(void *junk, unsigned long num)
+{
+	unsigned long i;
+
+	(void)junk;
+
+	for (i=0; i<NITEMS; i++) {
+		work_init(&items[num][i], countwork,
+			  (void *)(num * NITEMS + i));
+		if (!work_enqueue(system_wq, &items[num][i])) {
+			panic("workqueuetest: fresh work already queued\n");
+		}
+		if (i % 4 == 0) {
+			thread_yield();
+		}
+	}
+	V(donesem);
+}
+
+int
+workqueuetest(int nargs, char **args)
+{
+	struct work w;
+	unsigned long i;
+	unsigned queued;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting workqueue test...\n");
+
+	donesem = sem_create("workqueuetest", 0);
+	if (donesem == NULL) {
+		panic("workqueuetest: sem_create failed\n");
+	}
+	count = 0;
+
+	for (i=0; i<NQUEUERS; i++) {
+		result = thread_fork("queuer", NULL, queuer, NULL, i);
+		if (result) {
+			panic("workqueuetest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NQUEUERS; i++) {
+		P(donesem);
+	}
+
+	/* Everything queued must have run once flush returns. */
+	work_flush(system_wq);
+	if (count != NQUEUERS * NITEMS) {
+		panic("workqueuetest: %u of %u items ran by flush\n",
+		      count, NQUEUERS * NITEMS);
+	}
+
+	/*
+	 * Queueing again before it runs doesn't queue it twice, so it
+	 * runs as many times as work_enqueue said yes.
+	 */
+	work_init(&w, countwork, (void *)1);
+	spinlock_acquire(&countlock);
+	count = 0;
+	spinlock_release(&countlock);
+	queued = 0;
+	for (i=0; i<4; i++) {
+		if (work_enqueue(system_wq, &w)) {
+			queued++;
+		}
+	}
+	work_flush(system_wq);
+	if (count != queued) {
+		panic("workqueuetest: work queued %u times ran %u times\n",
+		      queued, count);
+	}
+
+	sem_destroy(donesem);
+	donesem = NULL;
+
+	kprintf("Workqueue test done.\n");
+	return 0;
+}
@@ -0,0 +1,347 @@
+/*
+ * Callouts, on per-cpu hierarchical timing wheels. See <callout.h>.
+ *
+ * A wheel has CW_LEVELS levels of CW_SLOTS slots each. Level 0 slots
+ * are one hardclock tick apart; each level up, slots are CW_SLOTS
+ * times wider. A callout goes in the lowest level whose span covers
+ * the time until it is due. Whenever the level-0 index wraps, the
+ * next slot of level 1 is cascaded (its callouts re-inserted lower
+ * down), and so on up. So scheduling and cancelling are O(1), and a
+ * tick only touches the callouts that are actually due or moving.
+ *
+ * The wheel's notion of the current tick comes from gettime_ns(),
+ * not from counting hardclocks, so missed ticks are caught up on.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <cpu.h>
+#include <clock.h>
+#include <current.h>
+#include <callout.h>
+
+#define CW_LEVELS	4
+#define CW_SLOTBITS	6
+#define CW_SLOTS	(1 << CW_SLOTBITS)
+#define CW_SLOTMASK	(CW_SLOTS - 1)
+
+/* Nanoseconds per hardclock tick. */
+#define CW_TICKNS	HARDCLOCK_NS
+
+struct callwheel {
+	struct spinlock cw_lock;
+	bool cw_started;		/* cw_tick has been set */
+	uint64_t cw_tick;		/* next tick to process */
+	unsigned cw_count;		/* number of pending callouts */
+	struct callout *cw_running;	/* callout being called, if any */
+	struct callout *cw_slots[CW_LEVELS][CW_SLOTS];
+};
+
+/*
+ * Current tick. Ticks are numbered from time 0, so the wheels on all
+ * cpus agree.
+ */
+static
+uint64_t
+callout_curtick(void)
+{
+	return gettime_ns() / CW_TICKNS;
+}
+
+/*
+ * Put a callout in the right slot. The wheel must be locked.
+ */
+static
+void
+callwheel_insert(struct callwheel *cw, struct callout *co)
+{
+	uint64_t delta;
+	unsigned level, slot;
+
+	KASSERT(spinlock_do_i_hold(&cw->cw_lock));
+
+	if (co->co_tick < cw->cw_tick) {
+		/* overdue; run on the next tick processed */
+		co->co_tick = cw->cw_tick;
+	}
+	delta = co->co_tick - cw->cw_tick;
+
+	for (level = 0; level < CW_LEVELS - 1; level++) {
+		if (delta < ((uint64_t)1 << (CW_SLOTBITS * (level + 1)))) {
+			break;
+		}
+	}
+	if (delta >= ((uint64_t)1 << (CW_SLOTBITS * CW_LEVELS))) {
+		/*
+		 * Beyond the end of the wheel. Park it in the last
+		 * slot the top level can see; it gets re-inserted
+		 * when that slot cascades.
+		 */
+		slot = ((cw->cw_tick >> (CW_SLOTBITS * level)) - 1)
+			& CW_SLOTMASK;
+	}
+	else {
+		slot = (co->co_tick >> (CW_SLOTBITS * level)) & CW_SLOTMASK;
+	}
+
+	co->co_next = cw->cw_slots[level][slot];
+	if (co->co_next != NULL) {
+		co->co_next->co_prevp = &co->co_next;
+	}
+	co->co_prevp = &cw->cw_slots[level][slot];
+	cw->cw_slots[level][slot] = co;
+}
+
+/*
+ * Take a callout off whatever slot it is in. The wheel must be
+ * locked.
+ */
+static
+void
+callwheel_remove(struct callwheel *cw, struct callout *co)
+{
+	KASSERT(spinlock_do_i_hold(&cw->cw_lock));
+	KASSERT(co->co_prevp != NULL);
+
+	*co->co_prevp = co->co_next;
+	if (co->co_next != NULL) {
+		co->co_next->co_prevp = co->co_prevp;
+	}
+	co->co_next = NULL;
+	co->co_prevp = NULL;
+}
+
+/*
+ * Re-insert everything in one slot of LEVEL. The wheel must be
+ * locked.
+ */
+static
+void
+callwheel_cascade(struct callwheel *cw, unsigned level, unsigned slot)
+{
+	struct callout *co, *next;
+
+	co = cw->cw_slots[level][slot];
+	cw->cw_slots[level][slot] = NULL;
+	for (; co != NULL; co = next) {
+		next = co->co_next;
+		callwheel_insert(cw, co);
+	}
+}
+
+void
+callout_cpu_init(struct cpu *c)
+{
+	struct callwheel *cw;
+	unsigned level, slot;
+
+	cw = kmalloc(sizeof(*cw));
+	if (cw == NULL) {
+		panic("callout_cpu_init: Out of memory\n");
+	}
+	spinlock_init(&cw->cw_lock);
+	cw->cw_started = false;
+	cw->cw_tick = 0;
+	cw->cw_count = 0;
+	cw->cw_running = NULL;
+	for (level = 0; level < CW_LEVELS; level++) {
+		for (slot = 0; slot < CW_SLOTS; slot++) {
+			cw->cw_slots[level][slot] = NULL;
+		}
+	}
+	c->c_callwheel = cw;
+}
+
+void
+callout_init(struct callout *co, void (*func)(void *), void *arg)
+{
+	co->co_next = NULL;
+	co->co_prevp = NULL;
+	co->co_tick = 0;
+	co->co_func = func;
+	co->co_arg = arg;
+	co->co_wheel = NULL;
+	co->co_pending = false;
+}
+
+void
+callout_schedule(struct callout *co, uint64_t deadline)
+{
+	struct callwheel *cw;
+
+	callout_stop(co);
+
+	/* If we migrate after this, it just runs on the other cpu. */
+	cw = curcpu->c_callwheel;
+
+	spinlock_acquire(&cw->cw_lock);
+	if (!cw->cw_started) {
+		cw->cw_tick = callout_curtick();
+		cw->cw_started = true;
+	}
+	co->co_tick = (deadline + CW_TICKNS - 1) / CW_TICKNS;
+	co->co_wheel = cw;
+	co->co_pending = true;
+	callwheel_insert(cw, co);
+	cw->cw_count++;
+	spinlock_release(&cw->cw_lock);
+}
+
+bool
+callout_stop(struct callout *co)
+{
+	struct callwheel *cw;
+
+ again:
+	cw = co->co_wheel;
+	if (cw == NULL) {
+		return false;
+	}
+
+	spinlock_acquire(&cw->cw_lock);
+	if (co->co_wheel != cw) {
+		/* moved while we weren't looking */
+		spinlock_release(&cw->cw_lock);
+		goto again;
+	}
+	if (co->co_pending) {
+		callwheel_remove(cw, co);
+		co->co_pending = false;
+		cw->cw_count--;
+		spinlock_release(&cw->cw_lock);
+		return true;
+	}
+
+	/*
+	 * Already fired. If it is running on another cpu right now,
+	 * wait for it to finish so the caller can safely reuse or free
+	 * the callout. (On our own cpu it is either finished or we are
+	 * it.)
+	 */
+	while (cw->cw_running == co && cw != curcpu->c_callwheel) {
+		spinlock_release(&cw->cw_lock);
+		spinlock_acquire(&cw->cw_lock);
+	}
+	spinlock_release(&cw->cw_lock);
+	return false;
+}
+
+/*
+ * Advance this cpu's wheel to the current time, calling everything
+ * that has come due. Called from hardclock.
+ */
+void
+callout_hardclock(void)
+{
+	struct callwheel *cw = curcpu->c_callwheel;
+	struct callout *co;
+	uint64_t now, t;
+	unsigned level, slot;
+
+	spinlock_acquire(&cw->cw_lock);
+	if (!cw->cw_started) {
+		spinlock_release(&cw->cw_lock);
+		return;
+	}
+
+	now = callout_curtick();
+	if (cw->cw_count == 0) {
+		/* nothing to do; just keep up */
+		if (cw->cw_tick <= now) {
+			cw->cw_tick = now + 1;
+		}
+		spinlock_release(&cw->cw_lock);
+		return;
+	}
+
+	while (cw->cw_tick <= now) {
+		t = cw->cw_tick;
+
+		/* Cascade the top levels first, so things fall through. */
+		for (level = CW_LEVELS - 1; level > 0; level--) {
+			if ((t & (((uint64_t)1 << (CW_SLOTBITS*level)) - 1))
+			    == 0) {
+				slot = (t >> (CW_SLOTBITS*level)) & CW_SLOTMASK;
+				callwheel_cascade(cw, level, slot);
+			}
+		}
+
+		slot = t & CW_SLOTMASK;
+		while ((co = cw->cw_slots[0][slot]) != NULL) {
+			KASSERT(co->co_tick == t);
+			callwheel_remove(cw, co);
+			co->co_pending = false;
+			cw->cw_count--;
+
+			/*
+			 * Call it without the lock, so it can reschedule
+			 * itself or take other spinlocks. After the call
+			 * the callout may belong to someone else again, so
+			 * only touch cw_running.
+			 */
+			cw->cw_running = co;
+			spinlock_release(&cw->cw_lock);
+			co->co_func(co->co_arg);
+			spinlock_acquire(&cw->cw_lock);
+			cw->cw_running = NULL;
+		}
+
+		cw->cw_tick = t + 1;
+	}
+	spinlock_release(&cw->cw_lock);
+}
+
+/*
+ * Time by which this cpu's wheel next needs attention: the earliest
+ * due callout, or the earliest cascade of a slot that has callouts in
+ * it, whichever comes first. Returns 0 if there are no callouts.
+ */
+uint64_t
+callout_nextdeadline(void)
+{
+	struct callwheel *cw = curcpu->c_callwheel;
+	uint64_t t, base, when, best;
+	unsigned level, k;
+
+	spinlock_acquire(&cw->cw_lock);
+	if (!cw->cw_started || cw->cw_count == 0) {
+		spinlock_release(&cw->cw_lock);
+		return 0;
+	}
+
+	t = cw->cw_tick;
+	best = 0;
+
+	/* level 0: slot k ahead holds callouts due at tick t+k */
+	for (k = 0; k < CW_SLOTS; k++) {
+		if (cw->cw_slots[0][(t + k) & CW_SLOTMASK] != NULL) {
+			best = t + k;
+			break;
+		}
+	}
+
+	/* higher levels: a slot matters when it cascades */
+	for (level = 1; level < CW_LEVELS; level++) {
+		base = t >> (CW_SLOTBITS * level);
+		for (k = 0; k <= CW_SLOTS; k++) {
+			when = (base + k) << (CW_SLOTBITS * level);
+			if (when < t) {
+				/* this revolution's cascade already happened */
+				continue;
+			}
+			if (best != 0 && when >= best) {
+				break;
+			}
+			if (cw->cw_slots[level][(base + k) & CW_SLOTMASK]
+			    != NULL) {
+				best = when;
+				break;
+			}
+		}
+	}
+	spinlock_release(&cw->cw_lock);
+
+	KASSERT(best != 0);
+	return best * CW_TICKNS;
+}
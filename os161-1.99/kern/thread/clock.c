@@ -34,13 +34,14 @@
 #include <clock.h>
 #include <thread.h>
 #include <current.h>
+#include <callout.h>
 
 /*
  * Time handling.
  *
- * This is pretty primitive. A real kernel will typically have some
- * kind of support for scheduling callbacks to happen at specific
- * points in the future, usually with more resolution that one second.
+ * Callbacks at specific points in the future are scheduled with
+ * callouts (see callout.c), which hardclock runs on each cpu. Timed
+ * sleeps are built on those.
  *
  * A real kernel also has to maintain the time of day; in OS/161 we
  * skimp on that because we have a known-good hardware clock.
@@ -54,9 +55,10 @@
 #define MIGRATE_HARDCLOCKS	16	/* Migrate every 16 hardclocks. */
 
 /*
- * Once a second, everything waiting on lbolt is awakened by CPU 0.
+ * Threads in thread_sleep_until sleep here. Nobody ever wakes this
+ * channel; each sleeper is woken by its own timeout.
  */
-static struct wchan *lbolt;
+static struct wchan *sleepchan;
 
 /*
  * Setup.
@@ -64,9 +66,9 @@ static struct wchan *lbolt;
 void
 hardclock_bootstrap(void)
 {
-	lbolt = wchan_create("lbolt");
-	if (lbolt == NULL) {
-		panic("Couldn't create lbolt\n");
+	sleepchan = wchan_create("sleep");
+	if (sleepchan == NULL) {
+		panic("Couldn't create sleepchan\n");
 	}
 }
 
@@ -77,8 +79,7 @@ hardclock_bootstrap(void)
 void
 timerclock(void)
 {
-	/* Just broadcast on lbolt */
-	wchan_wakeall(lbolt);
+	/* Nothing to do; timed sleeps use callouts. */
 }
 
 /*
@@ -93,24 +94,59 @@ hardclock(void)
 	 */
 
 	curcpu->c_hardclocks++;
+	callout_hardclock();
 	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
 		schedule();
 	}
 	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
 		thread_consider_migration();
 	}
+
+	/*
+	 * Time-slice, unless nothing else is waiting to run. (This
+	 * looks at the run queue without locking it; if we miss a
+	 * thread that just arrived, we'll see it next tick.)
+	 */
+	if (threadlist_isempty(&curcpu->c_runqueue)) {
+		curcpu->c_elidedyields++;
+		return;
+	}
 	thread_yield();
 }
 
+/*
+ * Current time in nanoseconds.
+ */
+uint64_t
+gettime_ns(void)
+{
+	time_t secs;
+	uint32_t nsecs;
+
+	gettime(&secs, &nsecs);
+	return (uint64_t)secs * 1000000000 + nsecs;
+}
+
+/*
+ * Suspend execution until DEADLINE.
+ */
+void
+thread_sleep_until(uint64_t deadline)
+{
+	while (gettime_ns() < deadline) {
+		wchan_lock(sleepchan);
+		wchan_sleep_until(sleepchan, deadline);
+	}
+}
+
 /*
  * Suspend execution for n seconds.
  */
 void
 clocksleep(int num_secs)
 {
-	while (num_secs > 0) {
-		wchan_lock(lbolt);
-		wchan_sleep(lbolt);
-		num_secs--;
+	if (num_secs > 0) {
+		thread_sleep_until(gettime_ns() +
+				   (uint64_t)num_secs * 1000000000);
 	}
 }
@@ -0,0 +1,310 @@
+/*
+ * Lock contention statistics. See <lockstat.h>.
+ *
+ * The statistics table cannot be protected by a spinlock, since
+ * spinlock_acquire itself reports here. Instead it has its own bare
+ * test-and-set word, taken with interrupts off, that is never
+ * counted.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <clock.h>
+#include <lockstat.h>
+
+/* Size of the slot table. Must be a power of 2. */
+#define LOCKSTAT_NSLOTS		256
+
+/* Longest lock name we keep; longer names are cut off. */
+#define LOCKSTAT_NAMELEN	24
+
+struct lockstat_slot {
+	int ls_kind;			/* LOCKSTAT_*, or 0 if unused */
+	vaddr_t ls_site;		/* call site, for spinlocks */
+	char ls_name[LOCKSTAT_NAMELEN];	/* name, for everything else */
+
+	unsigned ls_acquires;		/* times acquired */
+	unsigned ls_contended;		/* times we had to wait */
+	uint64_t ls_waittotal;		/* ns spent waiting */
+	uint64_t ls_waitmax;
+	uint64_t ls_holdtotal;		/* ns spent holding */
+	uint64_t ls_holdmax;
+};
+
+volatile bool lockstat_enabled = false;
+
+static struct lockstat_slot lockstat_slots[LOCKSTAT_NSLOTS];
+static volatile spinlock_data_t lockstat_guard = SPINLOCK_DATA_INITIALIZER;
+
+static
+void
+lockstat_lock(void)
+{
+	splraise(IPL_NONE, IPL_HIGH);
+	while (spinlock_data_get(&lockstat_guard) != 0 ||
+	       spinlock_data_testandset(&lockstat_guard) != 0) {
+		/* spin */
+	}
+}
+
+static
+void
+lockstat_unlock(void)
+{
+	spinlock_data_set(&lockstat_guard, 0);
+	spllower(IPL_HIGH, IPL_NONE);
+}
+
+void
+lockstat_bootstrap(void)
+{
+	lockstat_enabled = true;
+}
+
+uint64_t
+lockstat_now(void)
+{
+	return gettime_ns();
+}
+
+/*
+ * Compare a lock name with a (possibly truncated) slot name.
+ */
+static
+bool
+lockstat_samename(const char *slotname, const char *name)
+{
+	unsigned i;
+
+	for (i=0; i<LOCKSTAT_NAMELEN - 1; i++) {
+		if (slotname[i] != name[i]) {
+			return false;
+		}
+		if (name[i] == 0) {
+			return true;
+		}
+	}
+	return true;
+}
+
+/*
+ * Find the slot matching KIND plus NAME or SITE, starting the probe at
+ * HASH, and claim an empty one if there is no match. The table must
+ * be locked.
+ */
+static
+int
+lockstat_find(unsigned hash, int kind, const char *name, vaddr_t site)
+{
+	struct lockstat_slot *ls;
+	unsigned i, n;
+
+	for (n=0; n<LOCKSTAT_NSLOTS; n++) {
+		i = (hash + n) & (LOCKSTAT_NSLOTS - 1);
+		ls = &lockstat_slots[i];
+		if (ls->ls_kind == 0) {
+			ls->ls_kind = kind;
+			ls->ls_site = site;
+			if (name != NULL) {
+				snprintf(ls->ls_name, LOCKSTAT_NAMELEN,
+					 "%s", name);
+			}
+			return i;
+		}
+		if (ls->ls_kind != kind) {
+			continue;
+		}
+		if (name != NULL ?
+		    lockstat_samename(ls->ls_name, name) :
+		    ls->ls_site == site) {
+			return i;
+		}
+	}
+	/* Table full; don't count this one. */
+	return LOCKSTAT_NOSLOT;
+}
+
+int
+lockstat_slot_byname(int kind, const char *name)
+{
+	unsigned hash;
+	const char *s;
+	int slot;
+
+	KASSERT(kind != LOCKSTAT_SPINLOCK);
+
+	hash = kind;
+	for (s = name; *s != 0 && s < name + LOCKSTAT_NAMELEN - 1; s++) {
+		hash = hash*33 + (unsigned char)*s;
+	}
+
+	lockstat_lock();
+	slot = lockstat_find(hash, kind, name, 0);
+	lockstat_unlock();
+	return slot;
+}
+
+int
+lockstat_slot_bysite(vaddr_t site)
+{
+	int slot;
+
+	lockstat_lock();
+	/* low two bits of an instruction address are always zero */
+	slot = lockstat_find(site >> 2, LOCKSTAT_SPINLOCK, NULL, site);
+	lockstat_unlock();
+	return slot;
+}
+
+void
+lockstat_acquired(int slot, bool contended, uint64_t waitns)
+{
+	struct lockstat_slot *ls;
+
+	if (slot == LOCKSTAT_NOSLOT) {
+		return;
+	}
+	KASSERT(slot >= 0 && slot < LOCKSTAT_NSLOTS);
+	ls = &lockstat_slots[slot];
+
+	lockstat_lock();
+	ls->ls_acquires++;
+	if (contended) {
+		ls->ls_contended++;
+		ls->ls_waittotal += waitns;
+		if (waitns > ls->ls_waitmax) {
+			ls->ls_waitmax = waitns;
+		}
+	}
+	lockstat_unlock();
+}
+
+void
+lockstat_released(int slot, uint64_t holdns)
+{
+	struct lockstat_slot *ls;
+
+	if (slot == LOCKSTAT_NOSLOT) {
+		return;
+	}
+	KASSERT(slot >= 0 && slot < LOCKSTAT_NSLOTS);
+	ls = &lockstat_slots[slot];
+
+	lockstat_lock();
+	ls->ls_holdtotal += holdns;
+	if (holdns > ls->ls_holdmax) {
+		ls->ls_holdmax = holdns;
+	}
+	lockstat_unlock();
+}
+
+/*
+ * Zero the counters. The slots themselves stay assigned, since locks
+ * cache their slot numbers.
+ */
+void
+lockstat_reset(void)
+{
+	struct lockstat_slot *ls;
+	unsigned i;
+
+	lockstat_lock();
+	for (i=0; i<LOCKSTAT_NSLOTS; i++) {
+		ls = &lockstat_slots[i];
+		ls->ls_acquires = 0;
+		ls->ls_contended = 0;
+		ls->ls_waittotal = 0;
+		ls->ls_waitmax = 0;
+		ls->ls_holdtotal = 0;
+		ls->ls_holdmax = 0;
+	}
+	lockstat_unlock();
+}
+
+static
+const char *
+lockstat_kindname(int kind)
+{
+	switch (kind) {
+	    case LOCKSTAT_SPINLOCK: return "spin";
+	    case LOCKSTAT_LOCK: return "lock";
+	    case LOCKSTAT_SEM: return "sem";
+	    case LOCKSTAT_CV: return "cv";
+	}
+	return "?";
+}
+
+/*
+ * Print up to MAX slots, worst total wait time first.
+ *
+ * Work from a copy, because kmalloc and kprintf take spinlocks that
+ * want to report into the table we would otherwise be holding.
+ */
+void
+lockstat_print(unsigned max)
+{
+	struct lockstat_slot *copy, *ls;
+	bool *shown;
+	unsigned i, n, best;
+
+	copy = kmalloc(sizeof(lockstat_slots));
+	shown = kmalloc(LOCKSTAT_NSLOTS * sizeof(bool));
+	if (copy == NULL || shown == NULL) {
+		kprintf("lockstat: out of memory\n");
+		kfree(copy);
+		kfree(shown);
+		return;
+	}
+
+	lockstat_lock();
+	memcpy(copy, lockstat_slots, sizeof(lockstat_slots));
+	lockstat_unlock();
+
+	for (i=0; i<LOCKSTAT_NSLOTS; i++) {
+		shown[i] = copy[i].ls_acquires == 0;
+	}
+
+	kprintf("%-4s %-24s %9s %9s %12s %10s %12s %10s\n",
+		"kind", "name/site", "acquires", "contended",
+		"wait ns", "max wait", "hold ns", "max hold");
+
+	for (n=0; n<max; n++) {
+		best = LOCKSTAT_NSLOTS;
+		for (i=0; i<LOCKSTAT_NSLOTS; i++) {
+			if (shown[i]) {
+				continue;
+			}
+			if (best == LOCKSTAT_NSLOTS ||
+			    copy[i].ls_waittotal > copy[best].ls_waittotal ||
+			    (copy[i].ls_waittotal == copy[best].ls_waittotal &&
+			     copy[i].ls_acquires > copy[best].ls_acquires)) {
+				best = i;
+			}
+		}
+		if (best == LOCKSTAT_NSLOTS) {
+			break;
+		}
+		shown[best] = true;
+		ls = &copy[best];
+
+		if (ls->ls_kind == LOCKSTAT_SPINLOCK) {
+			kprintf("%-4s 0x%-22lx ", "spin",
+				(unsigned long)ls->ls_site);
+		}
+		else {
+			kprintf("%-4s %-24s ", lockstat_kindname(ls->ls_kind),
+				ls->ls_name);
+		}
+		kprintf("%9u %9u %12llu %10llu %12llu %10llu\n",
+			ls->ls_acquires, ls->ls_contended,
+			(unsigned long long)ls->ls_waittotal,
+			(unsigned long long)ls->ls_waitmax,
+			(unsigned long long)ls->ls_holdtotal,
+			(unsigned long long)ls->ls_holdmax);
+	}
+
+	kfree(copy);
+	kfree(shown);
+}
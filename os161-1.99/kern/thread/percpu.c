@@ -0,0 +1,87 @@
+/*
+ * Per-cpu counters. See <percpu.h>.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <cpu.h>
+#include <current.h>
+#include <percpu.h>
+
+struct pcpu_counters *
+pcpu_counters_create(unsigned num)
+{
+	struct pcpu_counters *pc;
+
+	pc = kmalloc(sizeof(*pc));
+	if (pc == NULL) {
+		return NULL;
+	}
+	pc->pc_num = num;
+	pc->pc_rowlen = PCPU_ROWLEN(num);
+	/* kmalloc aligns blocks this size to at least a cache line */
+	pc->pc_counts = kmalloc(PCPU_MAXCPUS * pc->pc_rowlen *
+				sizeof(unsigned));
+	if (pc->pc_counts == NULL) {
+		kfree(pc);
+		return NULL;
+	}
+	pcpu_counters_zero(pc);
+	return pc;
+}
+
+void
+pcpu_counters_destroy(struct pcpu_counters *pc)
+{
+	kfree(pc->pc_counts);
+	kfree(pc);
+}
+
+void
+pcpu_counter_add(struct pcpu_counters *pc, unsigned which, unsigned n)
+{
+	int spl;
+
+	KASSERT(which < pc->pc_num);
+
+	/*
+	 * With interrupts off we can neither be preempted onto another
+	 * cpu between finding our row and updating it, nor interrupted
+	 * by a handler counting into the same counter.
+	 */
+	spl = splhigh();
+	pc->pc_counts[curcpu->c_number * pc->pc_rowlen + which] += n;
+	splx(spl);
+}
+
+void
+pcpu_counter_inc(struct pcpu_counters *pc, unsigned which)
+{
+	pcpu_counter_add(pc, which, 1);
+}
+
+unsigned
+pcpu_counter_read(struct pcpu_counters *pc, unsigned which)
+{
+	unsigned i, n, total;
+
+	KASSERT(which < pc->pc_num);
+
+	total = 0;
+	n = cpu_count();
+	for (i=0; i<n; i++) {
+		total += pc->pc_counts[i * pc->pc_rowlen + which];
+	}
+	return total;
+}
+
+void
+pcpu_counters_zero(struct pcpu_counters *pc)
+{
+	unsigned i;
+
+	for (i=0; i<PCPU_MAXCPUS * pc->pc_rowlen; i++) {
+		pc->pc_counts[i] = 0;
+	}
+}
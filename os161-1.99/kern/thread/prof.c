@@ -0,0 +1,527 @@
+/*
+ * Sampling profiler. See <prof.h>.
+ *
+ * Each cpu only writes its own ring, from its timer interrupt, so the
+ * rings need no lock. prof_dump stops sampling while it reads them.
+ *
+ * The kernel's function symbols are read from its ELF image the first
+ * time they are needed and kept: reading them again each time would
+ * cost more memory than dumbvm can give back. For the same reason
+ * the report is tallied in static tables, so only one dump may run
+ * at a time (it is run from the menu).
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <lib.h>
+#include <array.h>
+#include <uio.h>
+#include <cpu.h>
+#include <current.h>
+#include <proc.h>
+#include <synch.h>
+#include <vfs.h>
+#include <vnode.h>
+#include <elf.h>
+#include <percpu.h>
+#include <mips/specialreg.h>
+#include <mips/trapframe.h>
+#include <prof.h>
+
+/* Samples kept per cpu. */
+#define PROF_NSAMPLES	2048
+
+/* Processes the per-process split can tell apart. */
+#define PROF_MAXPROCS	64
+
+/* Distinct functions (or pcs) the histogram can tell apart. */
+#define PROF_NBUCKETS	512
+
+/* Longest function name kept; longer ones are cut off. */
+#define PROF_NAMELEN	28
+
+struct prof_sample {
+	vaddr_t ps_pc;			/* interrupted pc */
+	pid_t ps_pid;			/* process running, or -1 */
+	bool ps_user;			/* pc was in user mode */
+};
+
+struct prof_ring {
+	unsigned pr_next;		/* slot to write next */
+	unsigned pr_total;		/* samples ever taken */
+	struct prof_sample pr_samples[PROF_NSAMPLES];
+};
+
+struct prof_sym {
+	vaddr_t sym_addr;
+	uint32_t sym_size;
+	char sym_name[PROF_NAMELEN];
+};
+
+static volatile bool prof_enabled = false;
+static struct prof_ring *prof_rings[PCPU_MAXCPUS];
+
+/* Kernel function symbols, sorted by address, once loaded. */
+static struct prof_sym *prof_syms;
+static unsigned prof_nsyms;
+
+int
+prof_start(void)
+{
+	struct prof_ring *pr;
+	unsigned i;
+
+	prof_enabled = false;
+	for (i=0; i<cpu_count(); i++) {
+		if (prof_rings[i] == NULL) {
+			/* kept for next time */
+			pr = kmalloc(sizeof(*pr));
+			if (pr == NULL) {
+				return ENOMEM;
+			}
+			prof_rings[i] = pr;
+		}
+		prof_rings[i]->pr_next = 0;
+		prof_rings[i]->pr_total = 0;
+	}
+	prof_enabled = true;
+	return 0;
+}
+
+void
+prof_stop(void)
+{
+	prof_enabled = false;
+}
+
+void
+prof_sample(struct trapframe *tf)
+{
+	struct prof_ring *pr;
+	struct prof_sample *ps;
+
+	if (!prof_enabled) {
+		return;
+	}
+	pr = prof_rings[curcpu->c_number];
+	if (pr == NULL) {
+		/* cpu started after prof_start; can't happen on sys161 */
+		return;
+	}
+
+	ps = &pr->pr_samples[pr->pr_next];
+	ps->ps_pc = tf->tf_epc;
+	ps->ps_user = (tf->tf_status & CST_KUp) != 0;
+#if OPT_A2
+	ps->ps_pid = curproc != NULL ? curproc->curpid : -1;
+#else
+	ps->ps_pid = -1;
+#endif
+	pr->pr_next = (pr->pr_next + 1) % PROF_NSAMPLES;
+	pr->pr_total++;
+}
+
+////////////////////////////////////////////////////////////
+// Kernel symbols
+
+/*
+ * Read LEN bytes at POS of V into BUF; EIO if the file is short.
+ */
+static
+int
+prof_read(struct vnode *v, off_t pos, void *buf, size_t len)
+{
+	struct iovec iov;
+	struct uio ku;
+	int result;
+
+	uio_kinit(&iov, &ku, buf, len, pos, UIO_READ);
+	result = VOP_READ(v, &ku);
+	if (result) {
+		return result;
+	}
+	return ku.uio_resid == 0 ? 0 : EIO;
+}
+
+/*
+ * Sort symbols by address (shell sort; there are a few thousand).
+ */
+static
+void
+prof_sortsyms(struct prof_sym *syms, unsigned n)
+{
+	struct prof_sym tmp;
+	unsigned gap, i, j;
+
+	for (gap = n/2; gap > 0; gap /= 2) {
+		for (i=gap; i<n; i++) {
+			tmp = syms[i];
+			for (j=i; j>=gap && syms[j-gap].sym_addr > tmp.sym_addr;
+			     j -= gap) {
+				syms[j] = syms[j-gap];
+			}
+			syms[j] = tmp;
+		}
+	}
+}
+
+/*
+ * Walk the symbol table of V, whose section header is SYMTAB and
+ * string table header STRTAB. With SYMS null, just count the
+ * function symbols; otherwise fill in up to MAX of them.
+ */
+static
+int
+prof_scansyms(struct vnode *v, const Elf_Shdr *symtab, const Elf_Shdr *strtab,
+	      struct prof_sym *syms, unsigned max, unsigned *ret)
+{
+	Elf_Sym sym;
+	uint32_t off;
+	unsigned n;
+	size_t len;
+	int result;
+
+	n = 0;
+	for (off = 0; off + sizeof(sym) <= symtab->sh_size;
+	     off += sizeof(sym)) {
+		result = prof_read(v, symtab->sh_offset + off,
+				   &sym, sizeof(sym));
+		if (result) {
+			return result;
+		}
+		if (ELF32_ST_TYPE(sym.st_info) != STT_FUNC ||
+		    sym.st_value == 0) {
+			continue;
+		}
+		if (syms != NULL) {
+			if (n == max) {
+				break;
+			}
+			syms[n].sym_addr = sym.st_value;
+			syms[n].sym_size = sym.st_size;
+
+			/* the name may be near the end of the table */
+			len = PROF_NAMELEN - 1;
+			if (sym.st_name >= strtab->sh_size) {
+				len = 0;
+			}
+			else if (strtab->sh_size - sym.st_name < len) {
+				len = strtab->sh_size - sym.st_name;
+			}
+			result = prof_read(v, strtab->sh_offset + sym.st_name,
+					   syms[n].sym_name, len);
+			if (result) {
+				return result;
+			}
+			syms[n].sym_name[len] = 0;
+		}
+		n++;
+	}
+	*ret = n;
+	return 0;
+}
+
+/*
+ * Load the function symbols from the kernel image at PATH.
+ */
+static
+int
+prof_loadsyms(const char *path)
+{
+	char *pathbuf;
+	struct vnode *v;
+	Elf_Ehdr eh;
+	Elf_Shdr symtab, strtab;
+	struct prof_sym *syms;
+	unsigned i, n;
+	int result;
+
+	/* vfs_open scribbles on the path */
+	pathbuf = kstrdup(path);
+	if (pathbuf == NULL) {
+		return ENOMEM;
+	}
+	result = vfs_open(pathbuf, O_RDONLY, 0, &v);
+	kfree(pathbuf);
+	if (result) {
+		return result;
+	}
+
+	result = prof_read(v, 0, &eh, sizeof(eh));
+	if (result) {
+		goto out;
+	}
+	if (eh.e_ident[EI_MAG0] != ELFMAG0 || eh.e_ident[EI_MAG1] != ELFMAG1 ||
+	    eh.e_ident[EI_MAG2] != ELFMAG2 || eh.e_ident[EI_MAG3] != ELFMAG3 ||
+	    eh.e_shentsize != sizeof(Elf_Shdr)) {
+		result = ENOEXEC;
+		goto out;
+	}
+
+	/* find the symbol table, and the string table it names */
+	symtab.sh_type = SHT_NULL;
+	for (i=0; i<eh.e_shnum; i++) {
+		result = prof_read(v, eh.e_shoff + i * sizeof(Elf_Shdr),
+				   &symtab, sizeof(symtab));
+		if (result) {
+			goto out;
+		}
+		if (symtab.sh_type == SHT_SYMTAB) {
+			break;
+		}
+	}
+	if (symtab.sh_type != SHT_SYMTAB || symtab.sh_link >= eh.e_shnum) {
+		/* stripped */
+		result = ENOENT;
+		goto out;
+	}
+	result = prof_read(v, eh.e_shoff + symtab.sh_link * sizeof(Elf_Shdr),
+			   &strtab, sizeof(strtab));
+	if (result) {
+		goto out;
+	}
+
+	result = prof_scansyms(v, &symtab, &strtab, NULL, 0, &n);
+	if (result) {
+		goto out;
+	}
+	syms = kmalloc(n * sizeof(*syms));
+	if (syms == NULL) {
+		result = ENOMEM;
+		goto out;
+	}
+	result = prof_scansyms(v, &symtab, &strtab, syms, n, &n);
+	if (result) {
+		kfree(syms);
+		goto out;
+	}
+	prof_sortsyms(syms, n);
+	prof_syms = syms;
+	prof_nsyms = n;
+
+ out:
+	vfs_close(v);
+	return result;
+}
+
+/*
+ * Index of the symbol containing PC, or prof_nsyms if none does.
+ */
+static
+unsigned
+prof_findsym(vaddr_t pc)
+{
+	unsigned lo, hi, mid;
+	struct prof_sym *sym;
+
+	/* find the last symbol at or below PC */
+	lo = 0;
+	hi = prof_nsyms;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (prof_syms[mid].sym_addr <= pc) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+	if (lo == 0) {
+		return prof_nsyms;
+	}
+	sym = &prof_syms[lo - 1];
+	if (sym->sym_size != 0 && pc >= sym->sym_addr + sym->sym_size) {
+		return prof_nsyms;
+	}
+	return lo - 1;
+}
+
+////////////////////////////////////////////////////////////
+// Report
+
+struct prof_bucket {
+	vaddr_t pb_key;			/* symbol index, or pc */
+	unsigned pb_count;
+};
+
+struct prof_proc {
+	pid_t pp_pid;
+	unsigned pp_user;
+	unsigned pp_kern;
+};
+
+static struct prof_bucket prof_buckets[PROF_NBUCKETS];
+static unsigned prof_nbuckets;
+static unsigned prof_dropped;		/* samples that didn't fit */
+static struct prof_proc prof_procs[PROF_MAXPROCS];
+static unsigned prof_nprocs;
+
+/*
+ * Add one to KEY's bucket. Linear, but only at dump time.
+ */
+static
+void
+prof_count(vaddr_t key)
+{
+	unsigned i;
+
+	for (i=0; i<prof_nbuckets; i++) {
+		if (prof_buckets[i].pb_key == key) {
+			prof_buckets[i].pb_count++;
+			return;
+		}
+	}
+	if (i == PROF_NBUCKETS) {
+		prof_dropped++;
+		return;
+	}
+	prof_buckets[i].pb_key = key;
+	prof_buckets[i].pb_count = 1;
+	prof_nbuckets++;
+}
+
+static
+void
+prof_countproc(pid_t pid, bool user)
+{
+	struct prof_proc *procs = prof_procs;
+	unsigned i;
+
+	for (i=0; i<prof_nprocs; i++) {
+		if (procs[i].pp_pid == pid) {
+			break;
+		}
+	}
+	if (i == prof_nprocs) {
+		if (i == PROF_MAXPROCS) {
+			return;
+		}
+		procs[i].pp_pid = pid;
+		procs[i].pp_user = 0;
+		procs[i].pp_kern = 0;
+		prof_nprocs++;
+	}
+	if (user) {
+		procs[i].pp_user++;
+	}
+	else {
+		procs[i].pp_kern++;
+	}
+}
+
+/*
+ * Print a process's name if it is still around.
+ */
+static
+void
+prof_printprocname(pid_t pid)
+{
+#if OPT_A2
+	char name[16];
+
+	if (pid <= 0) {
+		kprintf("%-16s", "-");
+		return;
+	}
+	kprintf("%-16s", proc_getname(pid, name, sizeof(name)) ?
+		name : "(exited)");
+#else
+	(void)pid;
+	kprintf("%-16s", "-");
+#endif
+}
+
+void
+prof_dump(const char *kernelpath, unsigned max)
+{
+	struct prof_bucket *buckets = prof_buckets;
+	struct prof_ring *pr;
+	struct prof_sample *ps;
+	unsigned ncpus, i, j, n, total, kern, best;
+	bool was, bysym;
+	int result;
+
+	was = prof_enabled;
+	prof_enabled = false;
+
+	if (prof_syms == NULL) {
+		result = prof_loadsyms(kernelpath);
+		if (result) {
+			kprintf("prof: no symbols from %s: %s; "
+				"showing raw pcs\n", kernelpath,
+				strerror(result));
+		}
+	}
+	bysym = prof_syms != NULL;
+
+	prof_nbuckets = prof_dropped = prof_nprocs = 0;
+	total = kern = 0;
+	ncpus = cpu_count();
+	for (i=0; i<ncpus; i++) {
+		pr = prof_rings[i];
+		if (pr == NULL) {
+			continue;
+		}
+		n = pr->pr_total < PROF_NSAMPLES ? pr->pr_total
+			: PROF_NSAMPLES;
+		for (j=0; j<n; j++) {
+			ps = &pr->pr_samples[j];
+			total++;
+			prof_countproc(ps->ps_pid, ps->ps_user);
+			if (ps->ps_user) {
+				continue;
+			}
+			kern++;
+			prof_count(bysym ? prof_findsym(ps->ps_pc) : ps->ps_pc);
+		}
+	}
+	if (total == 0) {
+		kprintf("prof: no samples\n");
+		prof_enabled = was;
+		return;
+	}
+
+	kprintf("%u samples, %u in the kernel\n", total, kern);
+	kprintf("%8s %6s  %s\n", "samples", "%", bysym ? "function" : "pc");
+	for (i=0; i<max; i++) {
+		best = prof_nbuckets;
+		for (j=0; j<prof_nbuckets; j++) {
+			if (buckets[j].pb_count != 0 &&
+			    (best == prof_nbuckets ||
+			     buckets[j].pb_count > buckets[best].pb_count)) {
+				best = j;
+			}
+		}
+		if (best == prof_nbuckets) {
+			break;
+		}
+		kprintf("%8u %5u%%  ", buckets[best].pb_count,
+			buckets[best].pb_count * 100 / total);
+		if (!bysym) {
+			kprintf("0x%08lx\n", (unsigned long)buckets[best].pb_key);
+		}
+		else if (buckets[best].pb_key == prof_nsyms) {
+			kprintf("(unknown)\n");
+		}
+		else {
+			kprintf("%s\n", prof_syms[buckets[best].pb_key].sym_name);
+		}
+		/* so it isn't picked again */
+		buckets[best].pb_count = 0;
+	}
+	if (prof_dropped > 0) {
+		kprintf("%8u %5u%%  (others not tallied)\n", prof_dropped,
+			prof_dropped * 100 / total);
+	}
+
+	kprintf("\n%5s %-16s %8s %8s\n", "pid", "process", "user", "kernel");
+	for (i=0; i<prof_nprocs; i++) {
+		kprintf("%5d ", prof_procs[i].pp_pid);
+		prof_printprocname(prof_procs[i].pp_pid);
+		kprintf(" %7u%% %7u%%\n", prof_procs[i].pp_user * 100 / total,
+			prof_procs[i].pp_kern * 100 / total);
+	}
+
+	prof_enabled = was;
+}
@@ -36,6 +36,7 @@
 #include <spl.h>
 #include <spinlock.h>
 #include <current.h>	/* for curcpu */
+#include <lockstat.h>
 
 /*
  * Spinlocks.
@@ -50,6 +51,10 @@ spinlock_init(struct spinlock *lk)
 {
 	spinlock_data_set(&lk->lk_lock, 0);
 	lk->lk_holder = NULL;
+#if OPT_LOCKSTAT
+	lk->lk_statslot = LOCKSTAT_NOSLOT;
+	lk->lk_stamp = 0;
+#endif
 }
 
 /*
@@ -73,6 +78,10 @@ void
 spinlock_acquire(struct spinlock *lk)
 {
 	struct cpu *mycpu;
+#if OPT_LOCKSTAT
+	bool contended = false;
+	uint64_t waitstart = 0;
+#endif
 
 	splraise(IPL_NONE, IPL_HIGH);
 
@@ -99,6 +108,12 @@ spinlock_acquire(struct spinlock *lk)
 		 * we don't.
 		 */
 		if (spinlock_data_get(&lk->lk_lock) != 0) {
+#if OPT_LOCKSTAT
+			if (!contended && lockstat_enabled) {
+				contended = true;
+				waitstart = lockstat_now();
+			}
+#endif
 			continue;
 		}
 		if (spinlock_data_testandset(&lk->lk_lock) != 0) {
@@ -108,6 +123,42 @@ spinlock_acquire(struct spinlock *lk)
 	}
 
 	lk->lk_holder = mycpu;
+
+#if OPT_LOCKSTAT
+	if (lockstat_enabled) {
+		lk->lk_statslot = lockstat_slot_bysite(
+			(vaddr_t)__builtin_return_address(0));
+		lk->lk_stamp = lockstat_now();
+		lockstat_acquired(lk->lk_statslot, contended,
+				  contended ? lk->lk_stamp - waitstart : 0);
+	}
+	else {
+		lk->lk_statslot = LOCKSTAT_NOSLOT;
+	}
+#endif
+}
+
+/*
+ * Get the lock only if it is free right now. For taking locks out of
+ * the usual order, where waiting could deadlock.
+ */
+bool
+spinlock_tryacquire(struct spinlock *lk)
+{
+	splraise(IPL_NONE, IPL_HIGH);
+
+	if (spinlock_data_get(&lk->lk_lock) != 0 ||
+	    spinlock_data_testandset(&lk->lk_lock) != 0) {
+		spllower(IPL_HIGH, IPL_NONE);
+		return false;
+	}
+
+	/* this must work before curcpu initialization */
+	lk->lk_holder = CURCPU_EXISTS() ? curcpu->c_self : NULL;
+#if OPT_LOCKSTAT
+	lk->lk_statslot = LOCKSTAT_NOSLOT;
+#endif
+	return true;
 }
 
 /*
@@ -121,6 +172,14 @@ spinlock_release(struct spinlock *lk)
 		KASSERT(lk->lk_holder == curcpu->c_self);
 	}
 
+#if OPT_LOCKSTAT
+	if (lk->lk_statslot != LOCKSTAT_NOSLOT) {
+		lockstat_released(lk->lk_statslot,
+				  lockstat_now() - lk->lk_stamp);
+		lk->lk_statslot = LOCKSTAT_NOSLOT;
+	}
+#endif
+
 	lk->lk_holder = NULL;
 	spinlock_data_set(&lk->lk_lock, 0);
 	spllower(IPL_HIGH, IPL_NONE);
@@ -39,6 +39,7 @@
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
+#include <lockstat.h>
 
 ////////////////////////////////////////////////////////////
 //
@@ -71,6 +72,9 @@ sem_create(const char *name, int initial_count)
 
 	spinlock_init(&sem->sem_lock);
         sem->sem_count = initial_count;
+#if OPT_LOCKSTAT
+        sem->sem_statslot = LOCKSTAT_NOSLOT;
+#endif
 
         return sem;
 }
@@ -90,6 +94,11 @@ sem_destroy(struct semaphore *sem)
 void 
 P(struct semaphore *sem)
 {
+#if OPT_LOCKSTAT
+        bool contended = false;
+        uint64_t waitstart = 0;
+#endif
+
         KASSERT(sem != NULL);
 
         /*
@@ -118,6 +127,12 @@ P(struct semaphore *sem)
 		 * Exercise: how would you implement strict FIFO
 		 * ordering?
 		 */
+#if OPT_LOCKSTAT
+		if (!contended && lockstat_enabled) {
+			contended = true;
+			waitstart = lockstat_now();
+		}
+#endif
 		wchan_lock(sem->sem_wchan);
 		spinlock_release(&sem->sem_lock);
                 wchan_sleep(sem->sem_wchan);
@@ -127,6 +142,18 @@ P(struct semaphore *sem)
         KASSERT(sem->sem_count > 0);
         sem->sem_count--;
 	spinlock_release(&sem->sem_lock);
+
+#if OPT_LOCKSTAT
+        if (lockstat_enabled) {
+                if (sem->sem_statslot == LOCKSTAT_NOSLOT) {
+                        sem->sem_statslot =
+                                lockstat_slot_byname(LOCKSTAT_SEM,
+                                                     sem->sem_name);
+                }
+                lockstat_acquired(sem->sem_statslot, contended,
+                                  contended ? lockstat_now() - waitstart : 0);
+        }
+#endif
 }
 
 void
@@ -147,6 +174,134 @@ V(struct semaphore *sem)
 //
 // Lock.
 
+/*
+ * Priority inheritance.
+ *
+ * A thread that blocks in lock_acquire records the lock in
+ * t_blockedon and donates its effective priority to the holder. If
+ * the holder is itself blocked on a lock, the donation is passed on
+ * to that lock's holder, and so on down the chain. Each lock also
+ * remembers the highest priority donated by its waiters, in
+ * lk_waitpri, so that when a thread releases a lock its effective
+ * priority can be recomputed from its base priority and the locks it
+ * still holds without looking at anyone's wait channel.
+ *
+ * None of this is touched unless a lock is contended: an acquire
+ * that doesn't have to wait, and a release with nobody waiting, only
+ * take the lock's own spinlock. lk_waitpri and lk_holder are under
+ * lk_lock; t_pri and t_blockedon are under the thread's t_pilock;
+ * t_heldlocks is only used by its own thread. Lock order is lk_lock,
+ * then t_pilock, then wait channels and run queues. Following a
+ * chain means taking the next lock's lk_lock while holding the
+ * previous holder's t_pilock, which is backwards, so that step only
+ * tries and backs off.
+ */
+
+/* Longer chains than this are almost certainly a deadlock; stop there. */
+#define PI_MAXDEPTH 16
+
+/*
+ * Donate PRI to LOCK's holder and whatever it is waiting for. The
+ * caller holds LOCK's lk_lock.
+ */
+static
+void
+pi_donate(struct lock *lock, int pri)
+{
+        struct lock *first, *next;
+        struct thread *t;
+        int depth;
+
+        KASSERT(spinlock_do_i_hold(&lock->lk_lock));
+
+        first = lock;
+        for (depth = 0; depth < PI_MAXDEPTH; depth++) {
+                if (lock->lk_waitpri < pri) {
+                        lock->lk_waitpri = pri;
+                }
+                t = lock->lk_holder;
+                if (t == NULL) {
+                        break;
+                }
+
+                /* t holds the lock we have locked, so it can't go away */
+                spinlock_acquire(&t->t_pilock);
+                if (t->t_pri >= pri) {
+                        spinlock_release(&t->t_pilock);
+                        break;
+                }
+                t->t_pri = pri;
+                thread_reprioritize(t);
+                for (;;) {
+                        next = t->t_blockedon;
+                        if (next == NULL ||
+                            spinlock_do_i_hold(&next->lk_lock)) {
+                                /* not blocked, or a cycle */
+                                next = NULL;
+                                break;
+                        }
+                        if (spinlock_tryacquire(&next->lk_lock)) {
+                                break;
+                        }
+                        /* let t finish whatever it is doing, and look again */
+                        spinlock_release(&t->t_pilock);
+                        spinlock_acquire(&t->t_pilock);
+                }
+                spinlock_release(&t->t_pilock);
+
+                if (lock != first) {
+                        spinlock_release(&lock->lk_lock);
+                }
+                lock = next;
+                if (lock == NULL) {
+                        break;
+                }
+        }
+        if (lock != NULL && lock != first) {
+                spinlock_release(&lock->lk_lock);
+        }
+}
+
+/*
+ * T's effective priority: its own, or the highest donated to a lock
+ * it holds. Called by T itself, holding its t_pilock.
+ */
+static
+int
+pi_compute(struct thread *t)
+{
+        struct lock *held;
+        int pri;
+
+        KASSERT(t == curthread);
+        KASSERT(spinlock_do_i_hold(&t->t_pilock));
+
+        pri = t->t_basepri;
+        for (held = t->t_heldlocks; held != NULL; held = held->lk_nextheld) {
+                if (held->lk_waitpri > pri) {
+                        pri = held->lk_waitpri;
+                }
+        }
+        return pri;
+}
+
+static
+void
+pi_setblockedon(struct lock *lock)
+{
+        spinlock_acquire(&curthread->t_pilock);
+        curthread->t_blockedon = lock;
+        spinlock_release(&curthread->t_pilock);
+}
+
+void
+lock_recompute_priority(void)
+{
+        spinlock_acquire(&curthread->t_pilock);
+        curthread->t_pri = pi_compute(curthread);
+        spinlock_release(&curthread->t_pilock);
+}
+
 struct lock *
 lock_create(const char *name)
 {
@@ -176,6 +331,13 @@ lock_create(const char *name)
         spinlock_init(&lock->lk_lock);
         lock->lk_holder = NULL;
         lock->lk_state = false;
+        lock->lk_nextheld = NULL;
+        lock->lk_waitpri = -1;
+        lock->lk_nwaiters = 0;
+#if OPT_LOCKSTAT
+        lock->lk_statslot = LOCKSTAT_NOSLOT;
+        lock->lk_stamp = 0;
+#endif
     
         return lock;
 }
@@ -197,6 +359,11 @@ lock_destroy(struct lock *lock)
 void
 lock_acquire(struct lock *lock)
 {
+#if OPT_LOCKSTAT
+        bool contended = false;
+        uint64_t waitstart = 0;
+#endif
+
         // Write this
         KASSERT(lock != NULL);
         KASSERT(curthread != NULL);
@@ -204,16 +371,57 @@ lock_acquire(struct lock *lock)
     
         spinlock_acquire(&lock->lk_lock);
     
-        while (lock->lk_state) {
-            wchan_lock(lock->lk_wchan);
-            spinlock_release(&lock->lk_lock);
-            wchan_sleep(lock->lk_wchan);
-            spinlock_acquire(&lock->lk_lock);
+        if (lock->lk_state) {
+            lock->lk_nwaiters++;
+            pi_setblockedon(lock);
+            do {
+#if OPT_LOCKSTAT
+                if (!contended && lockstat_enabled) {
+                    contended = true;
+                    waitstart = lockstat_now();
+                }
+#endif
+                /* lend our priority to the holder while we wait */
+                pi_donate(lock, curthread->t_pri);
+
+                wchan_lock(lock->lk_wchan);
+                spinlock_release(&lock->lk_lock);
+                wchan_sleep(lock->lk_wchan);
+                spinlock_acquire(&lock->lk_lock);
+            } while (lock->lk_state);
+            pi_setblockedon(NULL);
+            lock->lk_nwaiters--;
         }
     
         lock->lk_state = true;
         lock->lk_holder = curthread;
+        lock->lk_nextheld = curthread->t_heldlocks;
+        curthread->t_heldlocks = lock;
+
+        if (lock->lk_nwaiters > 0) {
+            /* whoever is still waiting is now waiting for us */
+            wchan_lock(lock->lk_wchan);
+            lock->lk_waitpri = wchan_maxpri(lock->lk_wchan);
+            wchan_unlock(lock->lk_wchan);
+            lock_recompute_priority();
+        }
+        else {
+            lock->lk_waitpri = -1;
+        }
+
         spinlock_release(&lock->lk_lock);
+
+#if OPT_LOCKSTAT
+        if (lockstat_enabled) {
+            if (lock->lk_statslot == LOCKSTAT_NOSLOT) {
+                lock->lk_statslot = lockstat_slot_byname(LOCKSTAT_LOCK,
+                                                         lock->lk_name);
+            }
+            lock->lk_stamp = lockstat_now();
+            lockstat_acquired(lock->lk_statslot, contended,
+                              contended ? lock->lk_stamp - waitstart : 0);
+        }
+#endif
         //(void)lock;
         // suppress warning until code gets written
 }
@@ -222,16 +430,46 @@ void
 lock_release(struct lock *lock)
 {
         // Write this
+        struct lock **pp;
+        int oldpri;
+
         KASSERT(lock != NULL);
         KASSERT(lock->lk_holder == curthread);
+
+#if OPT_LOCKSTAT
+        if (lock->lk_stamp != 0) {
+            lockstat_released(lock->lk_statslot,
+                              lockstat_now() - lock->lk_stamp);
+            lock->lk_stamp = 0;
+        }
+#endif
     
         spinlock_acquire(&lock->lk_lock);
         lock->lk_state = false;
         lock->lk_holder = NULL;
-
-        wchan_wakeone(lock->lk_wchan);
+        for (pp = &curthread->t_heldlocks; *pp != lock; pp = &(*pp)->lk_nextheld) {
+            KASSERT(*pp != NULL);
+        }
+        *pp = lock->lk_nextheld;
+        lock->lk_nextheld = NULL;
+
+        oldpri = curthread->t_pri;
+        if (lock->lk_nwaiters > 0) {
+            /* give back what this lock's waiters lent us */
+            lock_recompute_priority();
+            wchan_wakeone(lock->lk_wchan);
+        }
     
         spinlock_release(&lock->lk_lock);
+
+        /*
+         * If we were running on borrowed priority, whoever lent it
+         * should get the cpu now. Not if we're inside a spinlock,
+         * though (cv_wait calls us with the cv's wchan locked).
+         */
+        if (curthread->t_pri < oldpri && curthread->t_iplhigh_count == 0) {
+            thread_yield();
+        }
         //(void)lock;  // suppress warning until code gets written
 }
 
@@ -286,6 +524,9 @@ cv_create(const char *name)
             kfree(cv);
             return NULL;
         }
+#if OPT_LOCKSTAT
+        cv->cv_statslot = LOCKSTAT_NOSLOT;
+#endif
 
         return cv;
 }
@@ -308,10 +549,26 @@ cv_wait(struct cv *cv, struct lock *lock)
         KASSERT(cv != NULL);
         KASSERT(lock != NULL);
         KASSERT(lock_do_i_hold(lock));
+
+#if OPT_LOCKSTAT
+        uint64_t waitstart = lockstat_enabled ? lockstat_now() : 0;
+#endif
     
         wchan_lock(cv->cv_wchan);
         lock_release(lock);
         wchan_sleep(cv->cv_wchan);
+
+#if OPT_LOCKSTAT
+        /* every wait counts as contended; the wait is the time asleep */
+        if (lockstat_enabled && waitstart != 0) {
+            if (cv->cv_statslot == LOCKSTAT_NOSLOT) {
+                cv->cv_statslot = lockstat_slot_byname(LOCKSTAT_CV,
+                                                       cv->cv_name);
+            }
+            lockstat_acquired(cv->cv_statslot, true,
+                              lockstat_now() - waitstart);
+        }
+#endif
         lock_acquire(lock);
     
         // Write this
@@ -344,3 +601,176 @@ cv_broadcast(struct cv *cv, struct lock *lock)
         // (void)cv;    // suppress warning until code gets written
         // (void)lock;  // suppress warning until code gets written
 }
+
+////////////////////////////////////////////////////////////
+//
+// Reader-writer lock.
+
+struct rwlock *
+rwlock_create(const char *name)
+{
+        struct rwlock *rw;
+
+        rw = kmalloc(sizeof(struct rwlock));
+        if (rw == NULL) {
+                return NULL;
+        }
+
+        rw->rw_name = kstrdup(name);
+        if (rw->rw_name == NULL) {
+                kfree(rw);
+                return NULL;
+        }
+
+        rw->rw_readwchan = wchan_create(rw->rw_name);
+        if (rw->rw_readwchan == NULL) {
+                kfree(rw->rw_name);
+                kfree(rw);
+                return NULL;
+        }
+
+        rw->rw_writewchan = wchan_create(rw->rw_name);
+        if (rw->rw_writewchan == NULL) {
+                wchan_destroy(rw->rw_readwchan);
+                kfree(rw->rw_name);
+                kfree(rw);
+                return NULL;
+        }
+
+        spinlock_init(&rw->rw_lock);
+        rw->rw_writer = NULL;
+        rw->rw_readers = 0;
+        rw->rw_waitreaders = 0;
+        rw->rw_waitwriters = 0;
+        rw->rw_batch = 0;
+
+        return rw;
+}
+
+void
+rwlock_destroy(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+        KASSERT(rw->rw_writer == NULL);
+        KASSERT(rw->rw_readers == 0);
+
+        /* wchan_cleanup will assert if anyone's waiting on it */
+        spinlock_cleanup(&rw->rw_lock);
+        wchan_destroy(rw->rw_writewchan);
+        wchan_destroy(rw->rw_readwchan);
+
+        kfree(rw->rw_name);
+        kfree(rw);
+}
+
+void
+rwlock_acquire_read(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+        KASSERT(curthread->t_in_interrupt == false);
+
+        spinlock_acquire(&rw->rw_lock);
+        /*
+         * Stay out while a writer has the lock, and also while a
+         * writer is waiting unless we are part of the batch the last
+         * writer let through on its way out.
+         */
+        while (rw->rw_writer != NULL ||
+               (rw->rw_waitwriters > 0 && rw->rw_batch == 0)) {
+                rw->rw_waitreaders++;
+                wchan_lock(rw->rw_readwchan);
+                spinlock_release(&rw->rw_lock);
+                wchan_sleep(rw->rw_readwchan);
+                spinlock_acquire(&rw->rw_lock);
+                rw->rw_waitreaders--;
+        }
+        if (rw->rw_waitwriters > 0) {
+                KASSERT(rw->rw_batch > 0);
+                rw->rw_batch--;
+        }
+        rw->rw_readers++;
+        spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_read(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+
+        spinlock_acquire(&rw->rw_lock);
+        KASSERT(rw->rw_readers > 0);
+        KASSERT(rw->rw_writer == NULL);
+        rw->rw_readers--;
+        if (rw->rw_readers == 0 && rw->rw_waitwriters > 0) {
+                wchan_wakeone(rw->rw_writewchan);
+        }
+        spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_acquire_write(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+        KASSERT(curthread->t_in_interrupt == false);
+
+        spinlock_acquire(&rw->rw_lock);
+        KASSERT(rw->rw_writer != curthread);
+
+        /*
+         * A leftover batch only matters while the readers it was
+         * meant for are still on their way in.
+         */
+        if (rw->rw_waitreaders == 0) {
+                rw->rw_batch = 0;
+        }
+        while (rw->rw_writer != NULL || rw->rw_readers > 0 ||
+               (rw->rw_batch > 0 && rw->rw_waitreaders > 0)) {
+                rw->rw_waitwriters++;
+                wchan_lock(rw->rw_writewchan);
+                spinlock_release(&rw->rw_lock);
+                wchan_sleep(rw->rw_writewchan);
+                spinlock_acquire(&rw->rw_lock);
+                rw->rw_waitwriters--;
+        }
+        rw->rw_writer = curthread;
+        rw->rw_batch = 0;
+        spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_write(struct rwlock *rw)
+{
+        KASSERT(rw != NULL);
+
+        spinlock_acquire(&rw->rw_lock);
+        KASSERT(rw->rw_writer == curthread);
+        rw->rw_writer = NULL;
+
+        /*
+         * Readers that queued up behind us go next, as one bounded
+         * batch; the last of them to leave wakes the next writer.
+         * Otherwise hand straight off to a writer.
+         */
+        if (rw->rw_waitreaders > 0) {
+                rw->rw_batch = RWLOCK_READ_BATCH;
+                wchan_wakeall(rw->rw_readwchan);
+        }
+        else if (rw->rw_waitwriters > 0) {
+                wchan_wakeone(rw->rw_writewchan);
+        }
+        spinlock_release(&rw->rw_lock);
+}
+
+bool
+rwlock_do_i_hold_write(struct rwlock *rw)
+{
+        bool ret;
+
+        KASSERT(rw != NULL);
+
+        spinlock_acquire(&rw->rw_lock);
+        ret = (rw->rw_writer == curthread);
+        spinlock_release(&rw->rw_lock);
+
+        return ret;
+}
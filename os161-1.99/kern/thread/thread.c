@@ -50,6 +50,9 @@
 #include <addrspace.h>
 #include <mainbus.h>
 #include <vnode.h>
+#include <clock.h>
+#include <callout.h>
+#include <percpu.h>
 
 #include "opt-synchprobs.h"
 
@@ -57,6 +60,9 @@
 /* Magic number used as a guard value on kernel thread stacks. */
 #define THREAD_STACK_MAGIC 0xbaadf00d
 
+/* Most dead threads (with stacks) each cpu keeps for reuse. */
+#define THREAD_CACHE_MAX 16
+
 /* Wait channel. */
 struct wchan {
 	const char *wc_name;		/* name for this channel */
@@ -72,6 +78,17 @@ static struct cpuarray allcpus;
 /* Used to wait for secondary CPUs to come online. */
 static struct semaphore *cpu_startup_sem;
 
+/*
+ * Zombies waiting for the reaper thread. Protected by reaper_lock;
+ * the reaper sleeps on reaper_wchan while the list is empty.
+ */
+static struct threadlist reaper_zombies;
+static struct spinlock reaper_lock = SPINLOCK_INITIALIZER;
+static struct wchan *reaper_wchan;
+
+/* Set once gettime_ns can be called; see thread_stats_bootstrap. */
+static bool thread_stats_enabled = false;
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -112,44 +129,102 @@ thread_checkstack(struct thread *thread)
 }
 
 /*
- * Create a thread. This is used both to create a first thread
- * for each CPU and to create subsequent forked threads.
+ * Set a thread's name. Short names go in t_namebuf so that naming a
+ * thread doesn't usually cost a kmalloc.
  */
 static
-struct thread *
-thread_create(const char *name)
+int
+thread_setname(struct thread *thread, const char *name)
 {
-	struct thread *thread;
-
 	DEBUGASSERT(name != NULL);
 
-	thread = kmalloc(sizeof(*thread));
-	if (thread == NULL) {
-		return NULL;
+	if (strlen(name) < THREAD_NAMESIZE) {
+		strcpy(thread->t_namebuf, name);
+		thread->t_name = thread->t_namebuf;
 	}
+	else {
+		thread->t_name = kstrdup(name);
+		if (thread->t_name == NULL) {
+			return ENOMEM;
+		}
+	}
+	return 0;
+}
 
-	thread->t_name = kstrdup(name);
-	if (thread->t_name == NULL) {
-		kfree(thread);
-		return NULL;
+static
+void
+thread_clearname(struct thread *thread)
+{
+	if (thread->t_name != thread->t_namebuf) {
+		kfree(thread->t_name);
 	}
+	thread->t_name = NULL;
+}
+
+/*
+ * Initialize the fields of a new or recycled thread, other than its
+ * name and stack.
+ */
+static
+void
+thread_init(struct thread *thread)
+{
 	thread->t_wchan_name = "NEW";
 	thread->t_state = S_READY;
 
 	/* Thread subsystem fields */
 	thread_machdep_init(&thread->t_machdep);
 	threadlistnode_init(&thread->t_listnode, thread);
-	thread->t_stack = NULL;
 	thread->t_context = NULL;
 	thread->t_cpu = NULL;
 	thread->t_proc = NULL;
+	thread->t_wchan = NULL;
+	thread->t_utid = 0;
 
 	/* Interrupt state fields */
 	thread->t_in_interrupt = false;
 	thread->t_curspl = IPL_HIGH;
 	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
 
+	/* Scheduling fields */
+	thread->t_basepri = THREAD_PRI_DEFAULT;
+	spinlock_init(&thread->t_pilock);
+	thread->t_pri = THREAD_PRI_DEFAULT;
+	thread->t_blockedon = NULL;
+	thread->t_heldlocks = NULL;
+	thread->t_affinity = THREAD_AFFINITY_ALL;
+
+	/* Accounting fields */
+	thread->t_stamp = 0;
+	thread->t_runtime = 0;
+	thread->t_waittime = 0;
+	thread->t_nvcsw = 0;
+	thread->t_nivcsw = 0;
+
 	/* If you add to struct thread, be sure to initialize here */
+}
+
+/*
+ * Create a thread. This is used both to create a first thread
+ * for each CPU and to create subsequent forked threads.
+ */
+static
+struct thread *
+thread_create(const char *name)
+{
+	struct thread *thread;
+
+	thread = kmalloc(sizeof(*thread));
+	if (thread == NULL) {
+		return NULL;
+	}
+
+	if (thread_setname(thread, name)) {
+		kfree(thread);
+		return NULL;
+	}
+	thread->t_stack = NULL;
+	thread_init(thread);
 
 	return thread;
 }
@@ -168,6 +243,7 @@ cpu_create(unsigned hardware_number)
 	struct cpu *c;
 	int result;
 	char namebuf[16];
+	unsigned i;
 
 	c = kmalloc(sizeof(*c));
 	if (c == NULL) {
@@ -179,7 +255,17 @@ cpu_create(unsigned hardware_number)
 
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
+	c->c_leaving = NULL;
+	c->c_idlethread = NULL;
+	threadlist_init(&c->c_threadcache);
+	spinlock_init(&c->c_threadcache_lock);
 	c->c_hardclocks = 0;
+	c->c_elidedticks = 0;
+	c->c_elidedyields = 0;
+	callout_cpu_init(c);
+	for (i=0; i<CPU_SCHEDLAT_BUCKETS; i++) {
+		c->c_schedlat[i] = 0;
+	}
 
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
@@ -187,12 +273,18 @@ cpu_create(unsigned hardware_number)
 
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
+	c->c_tlbas = NULL;
+	c->c_ipisent = 0;
+	c->c_ipicoalesced = 0;
 	spinlock_init(&c->c_ipi_lock);
 
 	result = cpuarray_add(&allcpus, c, &c->c_number);
 	if (result != 0) {
 		panic("cpu_create: array_add: %s\n", strerror(result));
 	}
+	/* affinity masks have one bit per cpu */
+	KASSERT(c->c_number < 32);
+	KASSERT(c->c_number < PCPU_MAXCPUS);
 
 	snprintf(namebuf, sizeof(namebuf), "<boot #%d>", c->c_number);
 	c->c_curthread = thread_create(namebuf);
@@ -227,6 +319,18 @@ cpu_create(unsigned hardware_number)
 	return c;
 }
 
+unsigned
+cpu_count(void)
+{
+	return cpuarray_num(&allcpus);
+}
+
+struct cpu *
+cpu_get(unsigned n)
+{
+	return cpuarray_get(&allcpus, n);
+}
+
 /*
  * Destroy a thread.
  *
@@ -249,6 +353,8 @@ thread_destroy(struct thread *thread)
 
 	/* Thread subsystem fields */
 	KASSERT(thread->t_proc == NULL);
+	KASSERT(thread->t_heldlocks == NULL);
+	spinlock_cleanup(&thread->t_pilock);
 	if (thread->t_stack != NULL) {
 		kfree(thread->t_stack);
 	}
@@ -258,15 +364,91 @@ thread_destroy(struct thread *thread)
 	/* sheer paranoia */
 	thread->t_wchan_name = "DESTROYED";
 
-	kfree(thread->t_name);
+	thread_clearname(thread);
 	kfree(thread);
 }
 
 /*
- * Clean up zombies. (Zombies are threads that have exited but still
- * need to have thread_destroy called on them.)
+ * Put a dead thread, stack and all, on the thread cache of the cpu it
+ * last ran on instead of destroying it, if there's room. The stack's
+ * guard band is checked here rather than refilled when the thread is
+ * reused.
  *
- * The list of zombies is per-cpu.
+ * Going back to its own cpu keeps each cpu's cache stocked in
+ * proportion to the threads that exit there, which roughly matches
+ * where threads get forked, wherever the reaper happens to run.
+ */
+static
+bool
+thread_recycle(struct thread *thread)
+{
+	struct cpu *c;
+
+	KASSERT(thread != curthread);
+	KASSERT(thread->t_state != S_RUN);
+
+	c = thread->t_cpu;
+	if (thread->t_stack == NULL || c == NULL) {
+		return false;
+	}
+	/* unlocked peek; a slightly overfull cache does no harm */
+	if (c->c_threadcache.tl_count >= THREAD_CACHE_MAX) {
+		return false;
+	}
+
+	KASSERT(thread->t_proc == NULL);
+	KASSERT(thread->t_heldlocks == NULL);
+	spinlock_cleanup(&thread->t_pilock);
+	thread_checkstack(thread);
+	threadlistnode_cleanup(&thread->t_listnode);
+	thread_machdep_cleanup(&thread->t_machdep);
+	thread->t_wchan_name = "CACHED";
+	thread_clearname(thread);
+
+	spinlock_acquire(&c->c_threadcache_lock);
+	threadlist_addhead(&c->c_threadcache, thread);
+	spinlock_release(&c->c_threadcache_lock);
+	return true;
+}
+
+/*
+ * Get a thread with a stack from this cpu's thread cache, if there
+ * is one, and set it up as if by thread_create.
+ */
+static
+struct thread *
+thread_cache_get(const char *name)
+{
+	struct thread *thread;
+	struct cpu *c;
+
+	c = curcpu->c_self;
+	spinlock_acquire(&c->c_threadcache_lock);
+	thread = threadlist_remhead(&c->c_threadcache);
+	spinlock_release(&c->c_threadcache_lock);
+
+	if (thread == NULL) {
+		return NULL;
+	}
+	if (thread_setname(thread, name)) {
+		thread_destroy(thread);
+		return NULL;
+	}
+	thread_init(thread);
+	return thread;
+}
+
+/*
+ * Hand off zombies to the reaper. (Zombies are threads that have
+ * exited but still need to have thread_destroy called on them.)
+ *
+ * The list of zombies is per-cpu; a thread puts itself there while
+ * switching away for the last time, and the next thread to run on
+ * that cpu passes it along here. This runs at splhigh on every
+ * context switch, so it only moves list entries around; the actual
+ * freeing happens in the reaper thread.
+ *
+ * Until the reaper exists, zombies just stay where they are.
  */
 static
 void
@@ -274,10 +456,80 @@ exorcise(void)
 {
 	struct thread *z;
 
+	if (threadlist_isempty(&curcpu->c_zombies) || reaper_wchan == NULL) {
+		return;
+	}
+
+	spinlock_acquire(&reaper_lock);
 	while ((z = threadlist_remhead(&curcpu->c_zombies)) != NULL) {
 		KASSERT(z != curthread);
 		KASSERT(z->t_state == S_ZOMBIE);
-		thread_destroy(z);
+		threadlist_addtail(&reaper_zombies, z);
+	}
+	spinlock_release(&reaper_lock);
+
+	wchan_wakeone(reaper_wchan);
+}
+
+/*
+ * The reaper thread. Takes all the zombies there are at once and
+ * destroys them with interrupts on, keeping what it can in the
+ * thread cache for thread_fork to reuse.
+ */
+static
+void
+thread_reaper(void *data1, unsigned long data2)
+{
+	struct threadlist batch;
+	struct thread *z;
+
+	(void)data1;
+	(void)data2;
+
+	threadlist_init(&batch);
+
+	while (1) {
+		spinlock_acquire(&reaper_lock);
+		while (threadlist_isempty(&reaper_zombies)) {
+			wchan_lock(reaper_wchan);
+			spinlock_release(&reaper_lock);
+			wchan_sleep(reaper_wchan);
+			spinlock_acquire(&reaper_lock);
+		}
+		while ((z = threadlist_remhead(&reaper_zombies)) != NULL) {
+			threadlist_addtail(&batch, z);
+		}
+		spinlock_release(&reaper_lock);
+
+		while ((z = threadlist_remhead(&batch)) != NULL) {
+			if (!thread_recycle(z)) {
+				thread_destroy(z);
+			}
+		}
+	}
+}
+
+/*
+ * Start the reaper thread.
+ */
+static
+void
+thread_reaper_bootstrap(void)
+{
+	int result;
+
+	threadlist_init(&reaper_zombies);
+
+	/* Once this is set, exorcise starts handing over zombies. */
+	reaper_wchan = wchan_create("reaper");
+	if (reaper_wchan == NULL) {
+		panic("thread_bootstrap: Out of memory\n");
+	}
+
+	result = thread_fork("reaper", NULL, thread_reaper, NULL, 0);
+	if (result) {
+		panic("thread_bootstrap: thread_fork: %s\n",
+		      strerror(result));
 	}
 }
 
@@ -380,9 +632,32 @@ thread_bootstrap(void)
 	/* cpu_create() should have set t_proc. */
 	KASSERT(curthread->t_proc != NULL);
 
+	thread_reaper_bootstrap();
+
 	/* Done */
 }
 
+/*
+ * Start time accounting. Until the clock is attached gettime_ns
+ * can't be called, so before this the scheduler stamps nothing.
+ */
+void
+thread_stats_bootstrap(void)
+{
+	curthread->t_stamp = gettime_ns();
+	thread_stats_enabled = true;
+}
+
+/*
+ * Timestamp for accounting, or 0 if it isn't running yet.
+ */
+static
+uint64_t
+thread_stats_now(void)
+{
+	return thread_stats_enabled ? gettime_ns() : 0;
+}
+
 /*
  * New CPUs come here once MD initialization is finished. curthread
  * and curcpu should already be initialized.
@@ -406,6 +681,61 @@ cpu_hatch(unsigned software_number)
 	thread_exit();
 }
 
+/*
+ * Per-cpu idle threads. A thread that is moving to another cpu has to
+ * switch out completely before it can be queued there, so if there is
+ * nothing else to run, thread_switch switches to this cpu's idle
+ * thread instead of idling on the stack of the one that's leaving.
+ * The idle thread is never on a run queue; it just yields, which
+ * idles in its own context until there is something to run.
+ */
+static
+void
+thread_idle_loop(void *data1, unsigned long data2)
+{
+	(void)data1;
+	(void)data2;
+
+	while (1) {
+		thread_yield();
+	}
+}
+
+static
+void
+thread_idle_create(struct cpu *c)
+{
+	struct thread *t;
+	int result;
+
+	t = thread_create("idle");
+	if (t == NULL) {
+		panic("thread_idle_create: Out of memory\n");
+	}
+	t->t_stack = kmalloc(STACK_SIZE);
+	if (t->t_stack == NULL) {
+		panic("thread_idle_create: Out of memory\n");
+	}
+	thread_checkstack_init(t);
+
+	t->t_cpu = c;
+	t->t_affinity = (uint32_t)1 << c->c_number;
+	t->t_basepri = THREAD_PRI_MIN;
+	t->t_pri = THREAD_PRI_MIN;
+	result = proc_addthread(kproc, t);
+	if (result) {
+		panic("thread_idle_create: proc_addthread: %s\n",
+		      strerror(result));
+	}
+	/* comes out of thread_switch holding the run queue lock */
+	t->t_iplhigh_count++;
+	switchframe_init(t, thread_idle_loop, NULL, 0);
+
+	spinlock_acquire(&c->c_runqueue_lock);
+	c->c_idlethread = t;
+	spinlock_release(&c->c_runqueue_lock);
+}
+
 /*
  * Start up secondary cpus. Called from boot().
  */
@@ -424,12 +754,91 @@ thread_start_cpus(void)
 	}
 	sem_destroy(cpu_startup_sem);
 	cpu_startup_sem = NULL;
+
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		thread_idle_create(cpuarray_get(&allcpus, i));
+	}
+}
+
+/*
+ * Put a thread on a cpu's run queue, behind every thread of the same
+ * or higher priority and ahead of every lower-priority one. The run
+ * queue must be locked.
+ */
+static
+void
+thread_runqueue_insert(struct cpu *c, struct thread *t)
+{
+	struct thread *after;
+
+	KASSERT(spinlock_do_i_hold(&c->c_runqueue_lock));
+
+	THREADLIST_FORALL_REV(after, c->c_runqueue) {
+		if (after->t_pri >= t->t_pri) {
+			threadlist_insertafter(&c->c_runqueue, after, t);
+			return;
+		}
+	}
+	threadlist_addhead(&c->c_runqueue, t);
+}
+
+/*
+ * Affinity helpers. thread_cpu_ok says whether T may run on C.
+ */
+static
+bool
+thread_cpu_ok(struct thread *t, struct cpu *c)
+{
+	return (t->t_affinity & ((uint32_t)1 << c->c_number)) != 0;
+}
+
+static
+uint32_t
+thread_allcpus_mask(void)
+{
+	unsigned n = cpuarray_num(&allcpus);
+
+	return n >= 32 ? THREAD_AFFINITY_ALL : ((uint32_t)1 << n) - 1;
+}
+
+/*
+ * Choose a cpu for T to be queued on: the one it was last on if it is
+ * allowed there, otherwise the allowed cpu with the shortest run
+ * queue. The queue lengths are read unlocked, as a hint.
+ */
+static
+struct cpu *
+thread_pickcpu(struct thread *t)
+{
+	struct cpu *c, *best;
+	unsigned i, n;
+
+	if (t->t_cpu != NULL && thread_cpu_ok(t, t->t_cpu)) {
+		return t->t_cpu;
+	}
+
+	best = NULL;
+	n = cpuarray_num(&allcpus);
+	for (i=0; i<n; i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (!thread_cpu_ok(t, c)) {
+			continue;
+		}
+		if (best == NULL ||
+		    c->c_runqueue.tl_count < best->c_runqueue.tl_count) {
+			best = c;
+		}
+	}
+	KASSERT(best != NULL);
+	return best;
 }
 
 /*
  * Make a thread runnable.
  *
- * targetcpu might be curcpu; it might not be, too. 
+ * targetcpu might be curcpu; it might not be, too. The thread goes
+ * back on the cpu it last ran on; t_cpu is only changed for threads
+ * that are known to be switched out (see thread_switch).
  */
 static
 void
@@ -449,8 +858,11 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 		spinlock_acquire(&targetcpu->c_runqueue_lock);
 	}
 
+	/* start of its wait for a cpu */
+	target->t_stamp = thread_stats_now();
+
 	isidle = targetcpu->c_isidle;
-	threadlist_addtail(&targetcpu->c_runqueue, target);
+	thread_runqueue_insert(targetcpu, target);
 	if (isidle) {
 		/*
 		 * Other processor is idle; send interrupt to make
@@ -464,6 +876,87 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 	}
 }
 
+/*
+ * Make all the threads on LIST runnable, leaving it empty. The
+ * threads are grouped by the cpu each is to go on, so each run queue
+ * is locked once, and each idle cpu gets one IPI however many threads
+ * it is given.
+ */
+static
+void
+thread_make_runnable_list(struct threadlist *list)
+{
+	struct threadlist rest;
+	struct thread *target;
+	struct cpu *targetcpu;
+	uint64_t now;
+	unsigned n;
+	bool isidle;
+
+	if (list->tl_count == 0) {
+		return;
+	}
+
+	/* start of their wait for a cpu */
+	now = thread_stats_now();
+
+	threadlist_init(&rest);
+	while ((target = threadlist_remhead(list)) != NULL) {
+		targetcpu = target->t_cpu;
+
+		spinlock_acquire(&targetcpu->c_runqueue_lock);
+		isidle = targetcpu->c_isidle;
+		n = 0;
+		do {
+			if (target->t_cpu == targetcpu) {
+				target->t_stamp = now;
+				thread_runqueue_insert(targetcpu, target);
+				n++;
+			}
+			else {
+				threadlist_addtail(&rest, target);
+			}
+		} while ((target = threadlist_remhead(list)) != NULL);
+		spinlock_release(&targetcpu->c_runqueue_lock);
+
+		if (isidle) {
+			ipi_send(targetcpu, IPI_UNIDLE);
+			if (n > 1) {
+				spinlock_acquire(&targetcpu->c_ipi_lock);
+				targetcpu->c_ipicoalesced += n - 1;
+				spinlock_release(&targetcpu->c_ipi_lock);
+			}
+		}
+
+		/* go around again with the ones for other cpus */
+		while ((target = threadlist_remhead(&rest)) != NULL) {
+			threadlist_addtail(list, target);
+		}
+	}
+	threadlist_cleanup(&rest);
+}
+
+/*
+ * Send a thread that switched out of this cpu because its affinity
+ * no longer allows it here (see thread_switch) to a cpu that is
+ * allowed. Its context is saved by now, so it may be queued anywhere.
+ * Called after every switch, with no run queue locked.
+ */
+static
+void
+thread_leave(void)
+{
+	struct thread *t;
+
+	t = curcpu->c_leaving;
+	if (t == NULL) {
+		return;
+	}
+	curcpu->c_leaving = NULL;
+	t->t_cpu = thread_pickcpu(t);
+	thread_make_runnable(t, false);
+}
+
 /*
  * Create a new thread based on an existing one.
  *
@@ -479,33 +972,63 @@ thread_fork(const char *name,
 	    struct proc *proc,
 	    void (*entrypoint)(void *data1, unsigned long data2),
 	    void *data1, unsigned long data2)
+{
+	return thread_fork_affinity(name, proc, curthread->t_affinity,
+				    entrypoint, data1, data2);
+}
+
+/*
+ * thread_fork with a given cpu affinity mask.
+ */
+int
+thread_fork_affinity(const char *name,
+		     struct proc *proc,
+		     uint32_t affinity,
+		     void (*entrypoint)(void *data1, unsigned long data2),
+		     void *data1, unsigned long data2)
 {
 	struct thread *newthread;
 	int result;
 
+	affinity &= thread_allcpus_mask();
+	if (affinity == 0) {
+		return EINVAL;
+	}
+
 #ifdef UW
 	DEBUG(DB_THREADS,"Forking thread: %s\n",name);
 #endif // UW
 
-	newthread = thread_create(name);
+	/* Reuse a dead thread and its stack if we can */
+	newthread = thread_cache_get(name);
 	if (newthread == NULL) {
-		return ENOMEM;
-	}
+		newthread = thread_create(name);
+		if (newthread == NULL) {
+			return ENOMEM;
+		}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
-	if (newthread->t_stack == NULL) {
-		thread_destroy(newthread);
-		return ENOMEM;
+		/* Allocate a stack */
+		newthread->t_stack = kmalloc(STACK_SIZE);
+		if (newthread->t_stack == NULL) {
+			thread_destroy(newthread);
+			return ENOMEM;
+		}
+		thread_checkstack_init(newthread);
 	}
-	thread_checkstack_init(newthread);
 
 	/*
 	 * Now we clone various fields from the parent thread.
 	 */
 
 	/* Thread subsystem fields */
+	newthread->t_affinity = affinity;
+	/* here, if it's allowed here */
 	newthread->t_cpu = curthread->t_cpu;
+	newthread->t_cpu = thread_pickcpu(newthread);
+
+	/* Scheduling fields; donated priority is not inherited */
+	newthread->t_basepri = curthread->t_basepri;
+	newthread->t_pri = curthread->t_basepri;
 
 	/* Attach the new thread to its process */
 	if (proc == NULL) {
@@ -534,6 +1057,40 @@ thread_fork(const char *name,
 	return 0;
 }
 
+/*
+ * Idle this cpu until something happens. Rather than take a timer
+ * interrupt every tick, let the timer run until the next callout is
+ * due (or as long as it can, if there are none), and count the
+ * hardclocks we skipped. Called from thread_switch with interrupts
+ * off.
+ */
+static
+void
+thread_idle(void)
+{
+	uint64_t now, deadline;
+
+	if (curcpu->c_hardclocks == 0) {
+		/* Timer (and so the clock) not going yet; just wait. */
+		cpu_idle();
+		return;
+	}
+
+	now = gettime_ns();
+	deadline = callout_nextdeadline();
+	if (deadline != 0 && deadline < now + 2 * HARDCLOCK_NS) {
+		/* Due soon anyway; don't bother. */
+		cpu_idle();
+		return;
+	}
+
+	mainbus_settimer(deadline == 0 ? (uint64_t)-1 : deadline - now);
+	cpu_idle();
+	mainbus_settimer(0);
+
+	curcpu->c_elidedticks += (gettime_ns() - now) / HARDCLOCK_NS;
+}
+
 /*
  * High level, machine-independent context switch code.
  *
@@ -548,6 +1105,8 @@ void
 thread_switch(threadstate_t newstate, struct wchan *wc)
 {
 	struct thread *cur, *next;
+	uint64_t now, lat;
+	unsigned bucket;
 	int spl;
 
 	DEBUGASSERT(curcpu->c_curthread == curthread);
@@ -573,21 +1132,57 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	/* Lock the run queue. */
 	spinlock_acquire(&curcpu->c_runqueue_lock);
 
-	/* Micro-optimization: if nothing to do, just return */
-	if (newstate == S_READY && threadlist_isempty(&curcpu->c_runqueue)) {
+	/*
+	 * Micro-optimization: if nothing to do, just return. Yielding
+	 * to only lower-priority threads is also nothing to do.
+	 */
+	if (newstate == S_READY && cur != curcpu->c_idlethread &&
+	    thread_cpu_ok(cur, curcpu->c_self) &&
+	    (threadlist_isempty(&curcpu->c_runqueue) ||
+	     curcpu->c_runqueue.tl_head.tln_next->tln_self->t_pri <
+	     cur->t_pri)) {
 		spinlock_release(&curcpu->c_runqueue_lock);
 		splx(spl);
 		return;
 	}
 
+	/* Charge the time since it went on cpu (before re-stamping). */
+	now = thread_stats_now();
+	if (now != 0 && cur->t_stamp != 0) {
+		cur->t_runtime += now - cur->t_stamp;
+	}
+
 	/* Put the thread in the right place. */
 	switch (newstate) {
 	    case S_RUN:
 		panic("Illegal S_RUN in thread_switch\n");
 	    case S_READY:
-		thread_make_runnable(cur, true /*have lock*/);
+		/* yields from the timer interrupt are preemptions */
+		if (cur->t_in_interrupt) {
+			cur->t_nivcsw++;
+		}
+		else {
+			cur->t_nvcsw++;
+		}
+		if (cur == curcpu->c_idlethread) {
+			/* not queued; only switched to directly */
+		}
+		else if (!thread_cpu_ok(cur, curcpu->c_self)) {
+			/*
+			 * Not allowed here any more. It can't go on
+			 * another cpu's run queue until its context is
+			 * saved, so whoever runs here next sends it on
+			 * (thread_leave).
+			 */
+			KASSERT(curcpu->c_leaving == NULL);
+			curcpu->c_leaving = cur;
+		}
+		else {
+			thread_make_runnable(cur, true /*have lock*/);
+		}
 		break;
 	    case S_SLEEP:
+		cur->t_nvcsw++;
 		cur->t_wchan_name = wc->wc_name;
 		/*
 		 * Add the thread to the list in the wait channel, and
@@ -603,6 +1198,7 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 		 * without racing. Exercise: what's the other?)
 		 */
 		threadlist_addtail(&wc->wc_threads, cur);
+		cur->t_wchan = wc;
 		wchan_unlock(wc);
 		break;
 	    case S_ZOMBIE:
@@ -633,14 +1229,32 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	curcpu->c_isidle = true;
 	do {
 		next = threadlist_remhead(&curcpu->c_runqueue);
+		if (next == NULL && curcpu->c_leaving == cur &&
+		    curcpu->c_idlethread != NULL) {
+			/* don't idle on the stack of a thread that's going */
+			next = curcpu->c_idlethread;
+		}
 		if (next == NULL) {
 			spinlock_release(&curcpu->c_runqueue_lock);
-			cpu_idle();
+			thread_idle();
 			spinlock_acquire(&curcpu->c_runqueue_lock);
 		}
 	} while (next == NULL);
 	curcpu->c_isidle = false;
 
+	/* Charge next's wait for a cpu, and start its time on one. */
+	now = thread_stats_now();
+	if (now != 0 && next->t_stamp != 0) {
+		lat = now - next->t_stamp;
+		next->t_waittime += lat;
+		for (bucket = 0; bucket < CPU_SCHEDLAT_BUCKETS - 1 &&
+			     (lat >> (bucket + 1)) != 0; bucket++) {
+			/* log2 */
+		}
+		curcpu->c_schedlat[bucket]++;
+	}
+	next->t_stamp = now;
+
 	/*
 	 * Note that curcpu->c_curthread may be the same variable as
 	 * curthread and it may not be, depending on how curthread and
@@ -708,6 +1322,9 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	/* Unlock the run queue. */
 	spinlock_release(&curcpu->c_runqueue_lock);
 
+	/* Send on a thread that switched out to change cpus. */
+	thread_leave();
+
 	/* Activate our address space in the MMU. */
 	as_activate();
 
@@ -741,6 +1358,9 @@ thread_startup(void (*entrypoint)(void *data1, unsigned long data2),
 	/* Release the runqueue lock acquired in thread_switch. */
 	spinlock_release(&curcpu->c_runqueue_lock);
 
+	/* Send on a thread that switched out to change cpus. */
+	thread_leave();
+
 	/* Activate our address space in the MMU. */
 	as_activate();
 
@@ -773,7 +1393,7 @@ thread_startup(void (*entrypoint)(void *data1, unsigned long data2),
  *
  * The parts of the thread structure we don't actually need to run
  * should be cleaned up right away. The rest has to wait until
- * thread_destroy is called from exorcise().
+ * thread_destroy is called from the reaper thread.
  *
  * Does not return.
  */
@@ -817,6 +1437,74 @@ thread_yield(void)
 	thread_switch(S_READY, NULL);
 }
 
+/*
+ * Change the current thread's base priority.
+ */
+void
+thread_set_priority(int pri)
+{
+	int oldpri;
+
+	KASSERT(pri >= THREAD_PRI_MIN && pri <= THREAD_PRI_MAX);
+
+	oldpri = curthread->t_pri;
+	curthread->t_basepri = pri;
+	/* donations from lock waiters still apply on top */
+	lock_recompute_priority();
+
+	if (curthread->t_pri < oldpri) {
+		thread_yield();
+	}
+}
+
+/*
+ * Change the current thread's cpu affinity. If this cpu is no longer
+ * allowed, yield: thread_switch sends us to one that is.
+ */
+int
+thread_set_affinity(uint32_t mask)
+{
+	mask &= thread_allcpus_mask();
+	if (mask == 0) {
+		return EINVAL;
+	}
+
+	curthread->t_affinity = mask;
+	while (!thread_cpu_ok(curthread, curcpu->c_self)) {
+		thread_yield();
+	}
+	return 0;
+}
+
+/*
+ * T's effective priority changed (because of priority donation). If
+ * it is waiting on a run queue, move it to its new place there. If it
+ * is sleeping or running there is nothing to do; the new priority
+ * takes effect the next time it is queued.
+ */
+void
+thread_reprioritize(struct thread *t)
+{
+	struct cpu *c;
+	struct thread *q;
+
+	c = t->t_cpu;
+	spinlock_acquire(&c->c_runqueue_lock);
+	if (t->t_cpu != c) {
+		/* migrated under us; it was queued with a fresh look */
+		spinlock_release(&c->c_runqueue_lock);
+		return;
+	}
+	THREADLIST_FORALL(q, c->c_runqueue) {
+		if (q == t) {
+			threadlist_remove(&c->c_runqueue, t);
+			thread_runqueue_insert(c, t);
+			break;
+		}
+	}
+	spinlock_release(&c->c_runqueue_lock);
+}
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -856,10 +1544,10 @@ void
 thread_consider_migration(void)
 {
 	unsigned my_count, total_count, one_share, to_send;
-	unsigned i, numcpus;
+	unsigned i, n, numcpus;
 	struct cpu *c;
 	struct threadlist victims;
-	struct thread *t;
+	struct thread *t, *prev;
 
 	my_count = total_count = 0;
 	numcpus = cpuarray_num(&allcpus);
@@ -881,10 +1569,23 @@ thread_consider_migration(void)
 	to_send = my_count - one_share;
 	threadlist_init(&victims);
 	spinlock_acquire(&curcpu->c_runqueue_lock);
-	for (i=0; i<to_send; i++) {
-		t = threadlist_remtail(&curcpu->c_runqueue);
-		threadlist_addhead(&victims, t);
+	/*
+	 * The tail holds the lowest-priority threads; send those,
+	 * passing over any that are pinned to this cpu.
+	 */
+	n = 0;
+	t = curcpu->c_runqueue.tl_tail.tln_prev->tln_self;
+	while (t != NULL && n < to_send) {
+		prev = t->t_listnode.tln_prev->tln_self;
+		if ((t->t_affinity &
+		     ~((uint32_t)1 << curcpu->c_number)) != 0) {
+			threadlist_remove(&curcpu->c_runqueue, t);
+			threadlist_addhead(&victims, t);
+			n++;
+		}
+		t = prev;
 	}
+	to_send = n;
 	spinlock_release(&curcpu->c_runqueue_lock);
 
 	for (i=0; i < numcpus && to_send > 0; i++) {
@@ -893,7 +1594,10 @@ thread_consider_migration(void)
 			continue;
 		}
 		spinlock_acquire(&c->c_runqueue_lock);
-		while (c->c_runqueue.tl_count < one_share && to_send > 0) {
+		/* look at each victim at most once per cpu */
+		n = victims.tl_count;
+		while (n-- > 0 && c->c_runqueue.tl_count < one_share &&
+		       to_send > 0) {
 			t = threadlist_remhead(&victims);
 			/*
 			 * Ordinarily, curthread will not appear on
@@ -922,9 +1626,14 @@ thread_consider_migration(void)
 				to_send--;
 				continue;
 			}
+			if (!thread_cpu_ok(t, c)) {
+				/* maybe the next cpu */
+				threadlist_addtail(&victims, t);
+				continue;
+			}
 
 			t->t_cpu = c;
-			threadlist_addtail(&c->c_runqueue, t);
+			thread_runqueue_insert(c, t);
 			DEBUG(DB_THREADS,
 			      "Migrated thread %s: cpu %u -> %u",
 			      t->t_name, curcpu->c_number, c->c_number);
@@ -948,7 +1657,7 @@ thread_consider_migration(void)
 	if (!threadlist_isempty(&victims)) {
 		spinlock_acquire(&curcpu->c_runqueue_lock);
 		while ((t = threadlist_remhead(&victims)) != NULL) {
-			threadlist_addtail(&curcpu->c_runqueue, t);
+			thread_runqueue_insert(curcpu, t);
 		}
 		spinlock_release(&curcpu->c_runqueue_lock);
 	}
@@ -957,6 +1666,134 @@ thread_consider_migration(void)
 	threadlist_cleanup(&victims);
 }
 
+/*
+ * Run queue report, for the menu. Each cpu's queue is copied out
+ * under its lock and printed afterwards.
+ */
+#define RUNQ_SHOW	8
+
+struct runq_entry {
+	char re_name[THREAD_NAMESIZE];
+	int re_pri;
+	uint32_t re_affinity;
+};
+
+static
+void
+runq_copy(struct runq_entry *re, struct thread *t)
+{
+	snprintf(re->re_name, sizeof(re->re_name), "%s", t->t_name);
+	re->re_pri = t->t_pri;
+	re->re_affinity = t->t_affinity;
+}
+
+void
+thread_print_runqueues(void)
+{
+	struct runq_entry cur, queued[RUNQ_SHOW];
+	struct cpu *c;
+	struct thread *t;
+	unsigned i, j, n, count;
+	bool idle;
+
+	n = cpuarray_num(&allcpus);
+	for (i=0; i<n; i++) {
+		c = cpuarray_get(&allcpus, i);
+
+		spinlock_acquire(&c->c_runqueue_lock);
+		idle = c->c_isidle;
+		runq_copy(&cur, c->c_curthread);
+		count = c->c_runqueue.tl_count;
+		j = 0;
+		THREADLIST_FORALL(t, c->c_runqueue) {
+			if (j == RUNQ_SHOW) {
+				break;
+			}
+			runq_copy(&queued[j++], t);
+		}
+		spinlock_release(&c->c_runqueue_lock);
+
+		if (idle) {
+			kprintf("cpu%u: idle, %u queued\n", c->c_number, count);
+		}
+		else {
+			kprintf("cpu%u: running %s (pri %d, affinity 0x%x), "
+				"%u queued\n", c->c_number, cur.re_name,
+				cur.re_pri, cur.re_affinity, count);
+		}
+		for (j=0; j<count && j<RUNQ_SHOW; j++) {
+			kprintf("    %-24s pri %3d affinity 0x%x\n",
+				queued[j].re_name, queued[j].re_pri,
+				queued[j].re_affinity);
+		}
+		if (count > RUNQ_SHOW) {
+			kprintf("    ... and %u more\n", count - RUNQ_SHOW);
+		}
+	}
+}
+
+uint64_t
+thread_runtime(struct thread *t)
+{
+	uint64_t runtime, stamp, now;
+	int spl;
+
+	if (t != curthread) {
+		return t->t_runtime;
+	}
+
+	/* keep a switch from happening between the two reads */
+	spl = splhigh();
+	runtime = t->t_runtime;
+	stamp = t->t_stamp;
+	splx(spl);
+
+	now = thread_stats_now();
+	if (now != 0 && stamp != 0) {
+		runtime += now - stamp;
+	}
+	return runtime;
+}
+
+/*
+ * Scheduling latency report, for the menu. Buckets with nothing in
+ * them on any cpu are left out.
+ */
+void
+thread_print_schedlat(void)
+{
+	struct cpu *c;
+	unsigned i, b, n;
+	bool any;
+
+	n = cpuarray_num(&allcpus);
+	kprintf("%-14s", "latency (ns)");
+	for (i=0; i<n; i++) {
+		kprintf(" %8s%-2u", "cpu", i);
+	}
+	kprintf("\n");
+
+	for (b=0; b<CPU_SCHEDLAT_BUCKETS; b++) {
+		any = false;
+		for (i=0; i<n; i++) {
+			c = cpuarray_get(&allcpus, i);
+			if (c->c_schedlat[b] != 0) {
+				any = true;
+			}
+		}
+		if (!any) {
+			continue;
+		}
+		/* racy, but only statistics */
+		kprintf(">= %-11lu", 1UL << b);
+		for (i=0; i<n; i++) {
+			c = cpuarray_get(&allcpus, i);
+			kprintf(" %10u", c->c_schedlat[b]);
+		}
+		kprintf("\n");
+	}
+}
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -1029,16 +1866,92 @@ wchan_sleep(struct wchan *wc)
 }
 
 /*
- * Wake up one thread sleeping on a wait channel.
+ * State shared between wchan_sleep_until and its timeout callout.
+ */
+struct wchan_timeout {
+	struct thread *wt_thread;
+	struct wchan *wt_wchan;
+	bool wt_timedout;
+};
+
+/*
+ * Timeout for wchan_sleep_until: if the thread is still asleep on the
+ * channel, take it off and wake it. Runs from hardclock.
+ */
+static
+void
+wchan_timeout(void *arg)
+{
+	struct wchan_timeout *wt = arg;
+	struct thread *target = wt->wt_thread;
+
+	spinlock_acquire(&wt->wt_wchan->wc_lock);
+	if (target->t_wchan != wt->wt_wchan) {
+		/* somebody else woke it first */
+		spinlock_release(&wt->wt_wchan->wc_lock);
+		return;
+	}
+	threadlist_remove(&wt->wt_wchan->wc_threads, target);
+	target->t_wchan = NULL;
+	wt->wt_timedout = true;
+	spinlock_release(&wt->wt_wchan->wc_lock);
+
+	thread_make_runnable(target, false);
+}
+
+/*
+ * Like wchan_sleep, but give up at time DEADLINE (in nanoseconds, as
+ * from gettime_ns) if nobody has woken us by then. Returns 0 if woken
+ * and ETIMEDOUT if not. The channel must be locked, and will have been
+ * unlocked upon return.
+ */
+int
+wchan_sleep_until(struct wchan *wc, uint64_t deadline)
+{
+	struct wchan_timeout wt;
+	struct callout co;
+
+	KASSERT(!curthread->t_in_interrupt);
+
+	if (gettime_ns() >= deadline) {
+		wchan_unlock(wc);
+		return ETIMEDOUT;
+	}
+
+	wt.wt_thread = curthread;
+	wt.wt_wchan = wc;
+	wt.wt_timedout = false;
+	callout_init(&co, wchan_timeout, &wt);
+	callout_schedule(&co, deadline);
+
+	thread_switch(S_SLEEP, wc);
+
+	/* make sure the timeout is done with wt before it goes away */
+	callout_stop(&co);
+	return wt.wt_timedout ? ETIMEDOUT : 0;
+}
+
+/*
+ * Wake up one thread sleeping on a wait channel: the highest-priority
+ * one, oldest first among equals.
  */
 void
 wchan_wakeone(struct wchan *wc)
 {
-	struct thread *target;
+	struct thread *target, *t;
 
 	/* Lock the channel and grab a thread from it */
 	spinlock_acquire(&wc->wc_lock);
-	target = threadlist_remhead(&wc->wc_threads);
+	target = NULL;
+	THREADLIST_FORALL(t, wc->wc_threads) {
+		if (target == NULL || t->t_pri > target->t_pri) {
+			target = t;
+		}
+	}
+	if (target != NULL) {
+		threadlist_remove(&wc->wc_threads, target);
+		target->t_wchan = NULL;
+	}
 	/*
 	 * Nobody else can wake up this thread now, so we don't need
 	 * to hang onto the lock.
@@ -1070,6 +1983,7 @@ wchan_wakeall(struct wchan *wc)
 	 */
 	spinlock_acquire(&wc->wc_lock);
 	while ((target = threadlist_remhead(&wc->wc_threads)) != NULL) {
+		target->t_wchan = NULL;
 		threadlist_addtail(&list, target);
 	}
 	/*
@@ -1078,18 +1992,30 @@ wchan_wakeall(struct wchan *wc)
 	 */
 	spinlock_release(&wc->wc_lock);
 
-	/*
-	 * We could conceivably sort by cpu first to cause fewer lock
-	 * ops and fewer IPIs, but for now at least don't bother. Just
-	 * make each thread runnable.
-	 */
-	while ((target = threadlist_remhead(&list)) != NULL) {
-		thread_make_runnable(target, false);
-	}
-
+	thread_make_runnable_list(&list);
 	threadlist_cleanup(&list);
 }
 
+/*
+ * Return the highest priority among the sleepers on a locked wait
+ * channel, or -1 if it is empty. Used for priority inheritance.
+ */
+int
+wchan_maxpri(struct wchan *wc)
+{
+	struct thread *t;
+	int pri = -1;
+
+	KASSERT(spinlock_do_i_hold(&wc->wc_lock));
+
+	THREADLIST_FORALL(t, wc->wc_threads) {
+		if (t->t_pri > pri) {
+			pri = t->t_pri;
+		}
+	}
+	return pri;
+}
+
 /*
  * Return nonzero if there are no threads sleeping on the channel.
  * This is meant to be used only for diagnostic purposes.
@@ -1112,6 +2038,29 @@ wchan_isempty(struct wchan *wc)
  * Machine-independent IPI handling
  */
 
+/*
+ * Mark IPI CODE pending on TARGET and interrupt it, unless that bit
+ * is already pending: then an interrupt is on its way and will see
+ * this request too, since the handler takes c_ipi_lock before looking.
+ * The IPI lock must be held.
+ */
+static
+void
+ipi_post(struct cpu *target, int code)
+{
+	uint32_t bit = (uint32_t)1 << code;
+
+	KASSERT(spinlock_do_i_hold(&target->c_ipi_lock));
+
+	if (target->c_ipi_pending & bit) {
+		target->c_ipicoalesced++;
+		return;
+	}
+	target->c_ipi_pending |= bit;
+	target->c_ipisent++;
+	mainbus_send_ipi(target);
+}
+
 /*
  * Send an IPI (inter-processor interrupt) to the specified CPU.
  */
@@ -1121,8 +2070,7 @@ ipi_send(struct cpu *target, int code)
 	KASSERT(code >= 0 && code < 32);
 
 	spinlock_acquire(&target->c_ipi_lock);
-	target->c_ipi_pending |= (uint32_t)1 << code;
-	mainbus_send_ipi(target);
+	ipi_post(target, code);
 	spinlock_release(&target->c_ipi_lock);
 }
 
@@ -1156,8 +2104,7 @@ ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
 		target->c_numshootdown = n+1;
 	}
 
-	target->c_ipi_pending |= (uint32_t)1 << IPI_TLBSHOOTDOWN;
-	mainbus_send_ipi(target);
+	ipi_post(target, IPI_TLBSHOOTDOWN);
 
 	spinlock_release(&target->c_ipi_lock);
 }
@@ -1165,8 +2112,9 @@ ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
 void
 interprocessor_interrupt(void)
 {
+	struct tlbshootdown shootdown[TLBSHOOTDOWN_MAX];
 	uint32_t bits;
-	int i;
+	int i, numshootdown;
 
 	spinlock_acquire(&curcpu->c_ipi_lock);
 	bits = curcpu->c_ipi_pending;
@@ -1192,18 +2140,31 @@ interprocessor_interrupt(void)
 		 * interrupt; don't need to do anything else.
 		 */
 	}
+	numshootdown = 0;
 	if (bits & (1U << IPI_TLBSHOOTDOWN)) {
-		if (curcpu->c_numshootdown == TLBSHOOTDOWN_ALL) {
-			vm_tlbshootdown_all();
-		}
-		else {
-			for (i=0; i<curcpu->c_numshootdown; i++) {
-				vm_tlbshootdown(&curcpu->c_shootdown[i]);
-			}
+		numshootdown = curcpu->c_numshootdown;
+		for (i=0; i<numshootdown; i++) {
+			shootdown[i] = curcpu->c_shootdown[i];
 		}
 		curcpu->c_numshootdown = 0;
 	}
 
 	curcpu->c_ipi_pending = 0;
 	spinlock_release(&curcpu->c_ipi_lock);
+
+	/*
+	 * Do the shootdowns after letting go of the IPI lock. Finishing
+	 * one wakes up whoever asked for it, and a wakeup can need the
+	 * IPI lock of the woken thread's cpu; two cpus shooting down
+	 * each other's TLBs would then each be holding the lock the
+	 * other wants.
+	 */
+	if (numshootdown == TLBSHOOTDOWN_ALL) {
+		vm_tlbshootdown_all();
+	}
+	else {
+		for (i=0; i<numshootdown; i++) {
+			vm_tlbshootdown(&shootdown[i]);
+		}
+	}
 }
@@ -0,0 +1,216 @@
+/*
+ * Workqueues. See <workqueue.h>.
+ *
+ * Each worker has its own queue, lock, and wait channels, so cpus
+ * queueing work to their own workers don't contend. Whether a work
+ * item is queued can't be protected by any one worker's lock, since
+ * it may be queued from any cpu; it is a test-and-set word instead,
+ * set by whoever gets to queue it and cleared by the worker just
+ * before calling it.
+ *
+ * work_flush works from counts: a worker runs its items in order, so
+ * once its count of finished items reaches the count queued when the
+ * flush started, everything queued before then has run.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <cpu.h>
+#include <current.h>
+#include <thread.h>
+#include <proc.h>
+#include <workqueue.h>
+
+struct wq_worker {
+	struct spinlock wk_lock;
+	struct work *wk_head;		/* queued work, oldest first */
+	struct work **wk_tailp;
+	bool wk_idle;			/* worker is asleep on wk_wchan */
+	unsigned wk_queued;		/* items ever queued here */
+	unsigned wk_done;		/* items ever finished here */
+	unsigned wk_nflushers;		/* threads on wk_flushwchan */
+	struct wchan *wk_wchan;		/* worker waits for work */
+	struct wchan *wk_flushwchan;	/* work_flush waits for wk_done */
+};
+
+struct workqueue {
+	char *wq_name;
+	unsigned wq_nworkers;
+	struct wq_worker *wq_workers;
+};
+
+struct workqueue *system_wq;
+
+/*
+ * Worker thread. Takes everything queued, runs it, repeat.
+ */
+static
+void
+workqueue_worker(void *data1, unsigned long data2)
+{
+	struct wq_worker *wk = data1;
+	struct work *batch, *w, *next;
+	unsigned n;
+
+	(void)data2;
+
+	while (1) {
+		spinlock_acquire(&wk->wk_lock);
+		while (wk->wk_head == NULL) {
+			wk->wk_idle = true;
+			wchan_lock(wk->wk_wchan);
+			spinlock_release(&wk->wk_lock);
+			wchan_sleep(wk->wk_wchan);
+			spinlock_acquire(&wk->wk_lock);
+		}
+		batch = wk->wk_head;
+		wk->wk_head = NULL;
+		wk->wk_tailp = &wk->wk_head;
+		spinlock_release(&wk->wk_lock);
+
+		for (w = batch; w != NULL; w = next) {
+			/* after it is cleared, W may be queued again */
+			next = w->w_next;
+			spinlock_data_set(&w->w_pending, 0);
+			w->w_func(w->w_arg);
+
+			spinlock_acquire(&wk->wk_lock);
+			wk->wk_done++;
+			n = wk->wk_nflushers;
+			spinlock_release(&wk->wk_lock);
+			if (n > 0) {
+				wchan_wakeall(wk->wk_flushwchan);
+			}
+		}
+	}
+}
+
+struct workqueue *
+workqueue_create(const char *name, unsigned nworkers)
+{
+	struct workqueue *wq;
+	struct wq_worker *wk;
+	char namebuf[THREAD_NAMESIZE];
+	unsigned i;
+	int result;
+
+	if (nworkers == 0 || nworkers > cpu_count()) {
+		nworkers = cpu_count();
+	}
+
+	wq = kmalloc(sizeof(*wq));
+	if (wq == NULL) {
+		return NULL;
+	}
+	wq->wq_name = kstrdup(name);
+	wq->wq_workers = kmalloc(nworkers * sizeof(*wq->wq_workers));
+	if (wq->wq_name == NULL || wq->wq_workers == NULL) {
+		kfree(wq->wq_name);
+		kfree(wq->wq_workers);
+		kfree(wq);
+		return NULL;
+	}
+	wq->wq_nworkers = nworkers;
+
+	for (i=0; i<nworkers; i++) {
+		wk = &wq->wq_workers[i];
+		spinlock_init(&wk->wk_lock);
+		wk->wk_head = NULL;
+		wk->wk_tailp = &wk->wk_head;
+		wk->wk_idle = false;
+		wk->wk_queued = 0;
+		wk->wk_done = 0;
+		wk->wk_nflushers = 0;
+		wk->wk_wchan = wchan_create(wq->wq_name);
+		wk->wk_flushwchan = wchan_create(wq->wq_name);
+		if (wk->wk_wchan == NULL || wk->wk_flushwchan == NULL) {
+			/* workers already started can't be stopped */
+			panic("workqueue_create: Out of memory\n");
+		}
+
+		snprintf(namebuf, sizeof(namebuf), "%s/%u", name, i);
+		result = thread_fork_affinity(namebuf, kproc,
+					      (uint32_t)1 << i,
+					      workqueue_worker, wk, 0);
+		if (result) {
+			panic("workqueue_create: thread_fork: %s\n",
+			      strerror(result));
+		}
+	}
+	return wq;
+}
+
+void
+workqueue_bootstrap(void)
+{
+	system_wq = workqueue_create("events", 0);
+	if (system_wq == NULL) {
+		panic("workqueue_bootstrap: Out of memory\n");
+	}
+}
+
+void
+work_init(struct work *w, void (*func)(void *), void *arg)
+{
+	w->w_next = NULL;
+	w->w_func = func;
+	w->w_arg = arg;
+	spinlock_data_set(&w->w_pending, 0);
+}
+
+bool
+work_enqueue(struct workqueue *wq, struct work *w)
+{
+	struct wq_worker *wk;
+	bool wake;
+
+	if (spinlock_data_testandset(&w->w_pending) != 0) {
+		/* already queued */
+		return false;
+	}
+
+	/* If we migrate after this, it just runs on the other cpu. */
+	wk = &wq->wq_workers[curcpu->c_number % wq->wq_nworkers];
+
+	spinlock_acquire(&wk->wk_lock);
+	w->w_next = NULL;
+	*wk->wk_tailp = w;
+	wk->wk_tailp = &w->w_next;
+	wk->wk_queued++;
+	wake = wk->wk_idle;
+	wk->wk_idle = false;
+	spinlock_release(&wk->wk_lock);
+
+	if (wake) {
+		wchan_wakeone(wk->wk_wchan);
+	}
+	return true;
+}
+
+void
+work_flush(struct workqueue *wq)
+{
+	struct wq_worker *wk;
+	unsigned i, target;
+
+	KASSERT(!curthread->t_in_interrupt);
+
+	for (i=0; i<wq->wq_nworkers; i++) {
+		wk = &wq->wq_workers[i];
+
+		spinlock_acquire(&wk->wk_lock);
+		target = wk->wk_queued;
+		/* (the counts wrap; compare the difference) */
+		while ((int)(wk->wk_done - target) < 0) {
+			wk->wk_nflushers++;
+			wchan_lock(wk->wk_flushwchan);
+			spinlock_release(&wk->wk_lock);
+			wchan_sleep(wk->wk_flushwchan);
+			spinlock_acquire(&wk->wk_lock);
+			wk->wk_nflushers--;
+		}
+		spinlock_release(&wk->wk_lock);
+	}
+}
@@ -152,41 +152,23 @@ dowait(pid_t pid)
 }
 
 #ifdef WNOHANG
-/*
- * dowaitpoll
- * like dowait, but uses WNOHANG. returns true if we got something.
- */
-static
-int
-dowaitpoll(pid_t pid)
-{
-	int status;
-	pid_t result;
-	result = waitpid(pid, &status, WNOHANG);
-	if (result<0) {
-		warn("pid %d", pid);
-	}
-	else if (result!=0) {
-		printf("pid %d: ", pid);
-		printstatus(status);
-		printf("\n");
-		return 1;
-	}
-	return 0;
-}
-
 /*
  * waitpoll
- * poll all background jobs for having exited.
+ * reap any background jobs that have exited, without waiting.
  */
 static
 void
 waitpoll(void)
 {
-	int i;
-	for (i=0; i < MAXBG; i++) {
-		if (bgpids[i] != 0) {
-			if (dowaitpoll(bgpids[i])) {
+	int i, status;
+	pid_t pid;
+
+	while ((pid = waitpid(WAIT_ANY, &status, WNOHANG)) > 0) {
+		printf("pid %d: ", pid);
+		printstatus(status);
+		printf("\n");
+		for (i=0; i < MAXBG; i++) {
+			if (bgpids[i] == pid) {
 				bgpids[i] = 0;
 			}
 		}
@@ -354,26 +336,15 @@ docommand(char *buf)
 		__time(&startsecs, &startnsecs);
 	}
 
-	pid = fork();
-	switch (pid) {
-		case -1:
-			/* error */
-			warn("fork");
-			return _MKWAIT_EXIT(255);
-		case 0:
-			/* child */
-			execv(args[0], args);
-			warn("%s", args[0]);
-			/*
-			 * Use _exit() instead of exit() in the child
-			 * process to avoid calling atexit() functions,
-			 * which would cause hostcompat (if present) to
-			 * reset the tty state and mess up our input
-			 * handling.
-			 */
-			_exit(1);
-		default:
-			break;
+	/*
+	 * spawn starts the program in a new process directly, without
+	 * copying the shell's address space as fork+execv would. It
+	 * gets only the shell's standard input, output and error.
+	 */
+	pid = spawn(args[0], args, SPAWN_STDIO);
+	if (pid < 0) {
+		warn("%s", args[0]);
+		return _MKWAIT_EXIT(255);
 	}
 
 	/* parent */
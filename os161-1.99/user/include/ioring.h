@@ -0,0 +1,41 @@
+#ifndef _IORING_H_
+#define _IORING_H_
+
+/*
+ * Batched file I/O: queue reads, writes, fsyncs and closes on a ring
+ * and hand the lot to the kernel in one system call. See
+ * <kern/ioring.h> for the ring itself.
+ *
+ * A ring holds IORING_ENTRIES operations. Each one queued comes back
+ * as one completion, carrying the DATA it was queued with and what
+ * the equivalent system call would have returned, or -errno if it
+ * failed. The kernel won't take more operations than there is room
+ * for completions, so reap as you go.
+ */
+
+#include <sys/types.h>
+#include <kern/ioring.h>
+
+/* The system call: carry out up to COUNT queued operations. */
+int ioring_enter(struct ioring *ring, unsigned count);
+
+void ioring_init(struct ioring *ring);
+
+/* Queue an operation. Returns 0, or -1 if the ring is full. */
+int ioring_queue(struct ioring *ring, int op, int fd, void *buf,
+		 size_t len, off_t off, unsigned data);
+
+/* Operations queued but not yet taken by the kernel. */
+unsigned ioring_pending(struct ioring *ring);
+
+/*
+ * Submit everything queued. Returns the number the kernel took,
+ * which is less than were queued if the completion ring filled up,
+ * or -1 on error.
+ */
+int ioring_submit(struct ioring *ring);
+
+/* Take the next completion. Returns 1, or 0 if there is none. */
+int ioring_reap(struct ioring *ring, struct ioring_cqe *cqe);
+
+#endif /* _IORING_H_ */
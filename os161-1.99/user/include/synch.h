@@ -0,0 +1,34 @@
+#ifndef _SYNCH_H_
+#define _SYNCH_H_
+
+/*
+ * Mutexes and condition variables for user threads, built on the
+ * futex_wait and futex_wake system calls. Taking a free mutex or
+ * releasing one nobody is waiting for doesn't enter the kernel.
+ *
+ * Both can be set up with the initializers or the init functions;
+ * neither needs cleaning up.
+ */
+
+struct mutex {
+	volatile int m_state;	/* 0 free, 1 held, 2 held with waiters */
+};
+
+struct cond {
+	volatile int c_seq;	/* bumped by every signal */
+};
+
+#define MUTEX_INITIALIZER	{ 0 }
+#define COND_INITIALIZER	{ 0 }
+
+void mutex_init(struct mutex *m);
+void mutex_lock(struct mutex *m);
+int mutex_trylock(struct mutex *m);	/* 0 on success, -1 if held */
+void mutex_unlock(struct mutex *m);
+
+void cond_init(struct cond *c);
+void cond_wait(struct cond *c, struct mutex *m);
+void cond_signal(struct cond *c);
+void cond_broadcast(struct cond *c);
+
+#endif /* _SYNCH_H_ */
@@ -39,9 +39,11 @@
  */
 #include <kern/fcntl.h>
 #include <kern/ioctl.h>
+#include <kern/iovec.h>
 #include <kern/reboot.h>
 #include <kern/seek.h>
 #include <kern/time.h>
+#include <kern/resource.h> /* after kern/time.h */
 #include <kern/unistd.h>
 #include <kern/wait.h>
 
@@ -137,6 +139,10 @@ int rmdir(const char *dirname);
 int getpid(void);
 int ioctl(int filehandle, int code, void *buf);
 off_t lseek(int filehandle, off_t pos, int code);
+int readv(int filehandle, const struct iovec *iov, int iovcnt);
+int writev(int filehandle, const struct iovec *iov, int iovcnt);
+int pread(int filehandle, void *buf, size_t size, off_t pos);
+int pwrite(int filehandle, const void *buf, size_t size, off_t pos);
 int fsync(int filehandle);
 int ftruncate(int filehandle, off_t size);
 int remove(const char *filename);
@@ -153,7 +159,20 @@ int readlink(const char *path, char *buf, size_t buflen);
 int dup2(int filehandle, int newhandle);
 int pipe(int filehandles[2]);
 time_t __time(time_t *seconds, unsigned long *nanoseconds);
+int nanosleep(const struct timespec *request, struct timespec *remaining);
+int getrusage(int who, struct rusage *usage);
 int __getcwd(char *buf, size_t buflen);
+int __thread_create(void (*entry)(void *, void *), void *arg0, void *arg1);
+__DEAD void thread_exit(int code);
+int thread_join(int tid, int *code);
+int futex_wait(volatile int *addr, int val);
+int futex_wake(volatile int *addr, int count);
+int thread_setaffinity(unsigned mask, unsigned *oldmask);
+/* spawn: run PROG in a new process; FLAGS is 0 or SPAWN_STDIO */
+pid_t spawn(const char *prog, char *const *args, int flags);
+/* vfork: the child runs in our address space until it execs or exits */
+pid_t vfork(void);
+/* ioring_enter - see ioring.h */
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
 
@@ -163,5 +182,6 @@ int __getcwd(char *buf, size_t buflen);
 
 char *getcwd(char *buf, size_t buflen);		/* calls __getcwd */
 time_t time(time_t *seconds);			/* calls __time */
+int thread_create(int (*func)(void *), void *arg); /* calls __thread_create */
 
 #endif /* _UNISTD_H_ */
@@ -0,0 +1,64 @@
+#include <unistd.h>
+#include <ioring.h>
+
+/*
+ * Batched file I/O; see <ioring.h>.
+ *
+ * The kernel only touches the ring during ioring_enter, so plain
+ * loads and stores of the indexes are enough here.
+ */
+
+#define IORING_MASK	(IORING_ENTRIES - 1)
+
+void
+ioring_init(struct ioring *ring)
+{
+	ring->ir_sqhead = 0;
+	ring->ir_sqtail = 0;
+	ring->ir_cqhead = 0;
+	ring->ir_cqtail = 0;
+}
+
+int
+ioring_queue(struct ioring *ring, int op, int fd, void *buf, size_t len,
+	     off_t off, unsigned data)
+{
+	struct ioring_sqe *sqe;
+
+	if (ring->ir_sqtail - ring->ir_sqhead == IORING_ENTRIES) {
+		return -1;
+	}
+	sqe = &ring->ir_sq[ring->ir_sqtail & IORING_MASK];
+	sqe->sqe_off = off;
+	sqe->sqe_op = op;
+	sqe->sqe_fd = fd;
+	sqe->sqe_buf = buf;
+	sqe->sqe_len = len;
+	sqe->sqe_data = data;
+	sqe->sqe_pad = 0;
+	ring->ir_sqtail++;
+	return 0;
+}
+
+unsigned
+ioring_pending(struct ioring *ring)
+{
+	return ring->ir_sqtail - ring->ir_sqhead;
+}
+
+int
+ioring_submit(struct ioring *ring)
+{
+	return ioring_enter(ring, ioring_pending(ring));
+}
+
+int
+ioring_reap(struct ioring *ring, struct ioring_cqe *cqe)
+{
+	if (ring->ir_cqhead == ring->ir_cqtail) {
+		return 0;
+	}
+	*cqe = ring->ir_cq[ring->ir_cqhead & IORING_MASK];
+	ring->ir_cqhead++;
+	return 1;
+}
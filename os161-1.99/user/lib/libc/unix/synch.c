@@ -0,0 +1,151 @@
+#include <unistd.h>
+#include <synch.h>
+
+/*
+ * Mutexes and condition variables; see <synch.h>.
+ *
+ * The mutex is the three-state futex mutex: 0 free, 1 held, 2 held
+ * and someone may be asleep on it. Only an unlock that finds 2 has to
+ * call futex_wake, and only a lock that finds it held calls
+ * futex_wait.
+ */
+
+/*
+ * Atomically: if *P is OLD, set it to NEW. Returns the value *P had.
+ */
+static
+int
+atomic_cas(volatile int *p, int old, int new)
+{
+	int prev, tmp;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set noreorder;"	/* we fill the delay slots */
+		"1: ll %0, 0(%2);"	/*   prev = *p */
+		"bne %0, %3, 2f;"	/*   if prev != old, done */
+		"move %1, %4;"		/*   (delay slot) tmp = new */
+		"sc %1, 0(%2);"		/*   *p = tmp; tmp = success? */
+		"beqz %1, 1b;"		/*   lost it; try again */
+		"nop;"
+		"2: .set pop"		/* restore assembler mode */
+		: "=&r" (prev), "=&r" (tmp)
+		: "r" (p), "r" (old), "r" (new)
+		: "memory");
+	return prev;
+}
+
+/*
+ * Atomically: *P += DELTA. Returns the value *P had.
+ */
+static
+int
+atomic_add(volatile int *p, int delta)
+{
+	int prev;
+
+	do {
+		prev = *p;
+	} while (atomic_cas(p, prev, prev + delta) != prev);
+	return prev;
+}
+
+/*
+ * Atomically: *P = NEW. Returns the value *P had.
+ */
+static
+int
+atomic_swap(volatile int *p, int new)
+{
+	int prev;
+
+	do {
+		prev = *p;
+	} while (atomic_cas(p, prev, new) != prev);
+	return prev;
+}
+
+void
+mutex_init(struct mutex *m)
+{
+	m->m_state = 0;
+}
+
+int
+mutex_trylock(struct mutex *m)
+{
+	return atomic_cas(&m->m_state, 0, 1) == 0 ? 0 : -1;
+}
+
+void
+mutex_lock(struct mutex *m)
+{
+	int c;
+
+	c = atomic_cas(&m->m_state, 0, 1);
+	if (c == 0) {
+		return;
+	}
+	/*
+	 * Contended. Mark it as having waiters before sleeping; we may
+	 * not be the only one, so when we get it we leave it at 2.
+	 */
+	if (c != 2) {
+		c = atomic_swap(&m->m_state, 2);
+	}
+	while (c != 0) {
+		futex_wait(&m->m_state, 2);
+		c = atomic_swap(&m->m_state, 2);
+	}
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+	if (atomic_swap(&m->m_state, 0) == 2) {
+		futex_wake(&m->m_state, 1);
+	}
+}
+
+void
+cond_init(struct cond *c)
+{
+	c->c_seq = 0;
+}
+
+/*
+ * A signal between our reading c_seq and sleeping changes c_seq, so
+ * futex_wait returns at once and the signal isn't lost. Spurious
+ * wakeups are possible, as usual; callers loop on their condition.
+ */
+void
+cond_wait(struct cond *c, struct mutex *m)
+{
+	int seq, s;
+
+	seq = c->c_seq;
+	mutex_unlock(m);
+	futex_wait(&c->c_seq, seq);
+
+	/* others may be waiting too now, so take it marked contended */
+	s = atomic_swap(&m->m_state, 2);
+	while (s != 0) {
+		futex_wait(&m->m_state, 2);
+		s = atomic_swap(&m->m_state, 2);
+	}
+}
+
+void
+cond_signal(struct cond *c)
+{
+	atomic_add(&c->c_seq, 1);
+	futex_wake(&c->c_seq, 1);
+}
+
+void
+cond_broadcast(struct cond *c)
+{
+	atomic_add(&c->c_seq, 1);
+	futex_wake(&c->c_seq, 0x7fffffff);
+}
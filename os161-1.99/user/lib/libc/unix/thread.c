@@ -0,0 +1,23 @@
+#include <unistd.h>
+
+/*
+ * User threads. The kernel starts a new thread at __thread_start,
+ * on a fresh stack of its own, with the two values given to
+ * __thread_create; we use them for the function and its argument.
+ * Returning from the function exits the thread.
+ */
+
+static
+void
+__thread_start(void *func, void *arg)
+{
+	int (*f)(void *) = (int (*)(void *))func;
+
+	thread_exit(f(arg));
+}
+
+int
+thread_create(int (*func)(void *), void *arg)
+{
+	return __thread_create(__thread_start, (void *)func, arg);
+}
@@ -0,0 +1,144 @@
+/*
+ * forkbench - fork/exit/waitpid throughput.
+ *
+ * Forks NPROCS children in batches of BATCH; each child exits at once
+ * and the parent waits for the whole batch before starting the next.
+ * Reports the average cost of one fork+exit+waitpid. With BATCH
+ * children alive at once this also exercises the process table with
+ * many live entries, and since pids are reused across batches, pid
+ * allocation after the table has filled up.
+ *
+ * Then compares the latency of launching a program, NLAUNCH times
+ * each way: fork+execv, which copies our address space first;
+ * vfork+execv, which lends it to the child instead; and spawn, which
+ * doesn't involve it at all.
+ *
+ * Usage: forkbench [procs [batch]]
+ */
+
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <err.h>
+
+#define NPROCS		2000
+#define BATCH		16
+#define MAXBATCH	256
+#define NLAUNCH		100
+#define PROG		"/bin/true"
+
+/* ways to launch */
+#define L_FORK		0
+#define L_VFORK		1
+#define L_SPAWN		2
+
+static
+unsigned long long
+now_ns(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	__time(&secs, &nsecs);
+	return secs * 1000000000ULL + nsecs;
+}
+
+static
+void
+reap(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "pid %d: bad exit status 0x%x", pid, status);
+	}
+}
+
+/*
+ * Launch PROG NLAUNCH times, one at a time, in way HOW, and return
+ * the average ns per launch (including the wait).
+ */
+static
+unsigned long long
+launch(int how)
+{
+	char *args[2] = { (char *)PROG, NULL };
+	unsigned long long start;
+	pid_t pid;
+	int i;
+
+	start = now_ns();
+	for (i=0; i<NLAUNCH; i++) {
+		if (how == L_SPAWN) {
+			pid = spawn(PROG, args, 0);
+			if (pid < 0) {
+				err(1, "spawn: %s", PROG);
+			}
+		}
+		else {
+			pid = how == L_VFORK ? vfork() : fork();
+			if (pid < 0) {
+				err(1, how == L_VFORK ? "vfork" : "fork");
+			}
+			if (pid == 0) {
+				execv(PROG, args);
+				_exit(1);
+			}
+		}
+		reap(pid);
+	}
+	return (now_ns() - start) / NLAUNCH;
+}
+
+int
+main(int argc, char *argv[])
+{
+	pid_t pids[MAXBATCH];
+	unsigned long long start, end;
+	unsigned long long forkexec, vforkexec, spawned;
+	int nprocs = NPROCS, batch = BATCH;
+	int done, i, n;
+
+	if (argc > 1) {
+		nprocs = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		batch = atoi(argv[2]);
+	}
+	if (nprocs <= 0 || batch <= 0 || batch > MAXBATCH) {
+		errx(1, "Usage: forkbench [procs [batch]]");
+	}
+
+	start = now_ns();
+	for (done = 0; done < nprocs; done += n) {
+		n = nprocs - done < batch ? nprocs - done : batch;
+		for (i=0; i<n; i++) {
+			pids[i] = fork();
+			if (pids[i] < 0) {
+				err(1, "fork");
+			}
+			if (pids[i] == 0) {
+				_exit(0);
+			}
+		}
+		for (i=0; i<n; i++) {
+			reap(pids[i]);
+		}
+	}
+	end = now_ns();
+
+	printf("forkbench: %d procs, %d at a time, %llu ns each\n",
+	       nprocs, batch, (end - start) / nprocs);
+
+	forkexec = launch(L_FORK);
+	vforkexec = launch(L_VFORK);
+	spawned = launch(L_SPAWN);
+	printf("forkbench: %s launch: fork+execv %llu ns, "
+	       "vfork+execv %llu ns, spawn %llu ns\n",
+	       PROG, forkexec, vforkexec, spawned);
+	return 0;
+}
@@ -0,0 +1,104 @@
+/*
+ * pingpong - user thread handoff latency.
+ *
+ * Two threads take turns through a mutex and a pair of condition
+ * variables, NROUNDS round trips, and we report the average time per
+ * round trip. Every handoff has a sleeper to wake, so this measures
+ * the contended path: futex_wait and futex_wake plus a context
+ * switch each way. Then one thread locks and unlocks an uncontended
+ * mutex, which should not enter the kernel at all.
+ *
+ * Usage: pingpong [rounds]
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <err.h>
+#include <synch.h>
+
+#define NROUNDS		10000
+#define NUNCONTENDED	1000000
+
+static struct mutex lock = MUTEX_INITIALIZER;
+static struct cond pinged = COND_INITIALIZER;
+static struct cond ponged = COND_INITIALIZER;
+static volatile int turn;	/* 0: ping's turn, 1: pong's */
+static int rounds = NROUNDS;
+
+static
+unsigned long long
+now_ns(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	__time(&secs, &nsecs);
+	return secs * 1000000000ULL + nsecs;
+}
+
+static
+int
+pong(void *junk)
+{
+	int i;
+
+	(void)junk;
+	mutex_lock(&lock);
+	for (i=0; i<rounds; i++) {
+		while (turn != 1) {
+			cond_wait(&pinged, &lock);
+		}
+		turn = 0;
+		cond_signal(&ponged);
+	}
+	mutex_unlock(&lock);
+	return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned long long start, end;
+	int i, tid;
+
+	if (argc > 1) {
+		rounds = atoi(argv[1]);
+		if (rounds <= 0) {
+			errx(1, "Usage: pingpong [rounds]");
+		}
+	}
+
+	tid = thread_create(pong, NULL);
+	if (tid < 0) {
+		err(1, "thread_create");
+	}
+
+	start = now_ns();
+	mutex_lock(&lock);
+	for (i=0; i<rounds; i++) {
+		turn = 1;
+		cond_signal(&pinged);
+		while (turn != 0) {
+			cond_wait(&ponged, &lock);
+		}
+	}
+	mutex_unlock(&lock);
+	end = now_ns();
+
+	if (thread_join(tid, NULL) < 0) {
+		err(1, "thread_join");
+	}
+	printf("pingpong: %d round trips, %llu ns each\n",
+	       rounds, (end - start) / rounds);
+
+	start = now_ns();
+	for (i=0; i<NUNCONTENDED; i++) {
+		mutex_lock(&lock);
+		mutex_unlock(&lock);
+	}
+	end = now_ns();
+	printf("pingpong: uncontended lock+unlock, %llu ns each\n",
+	       (end - start) / NUNCONTENDED);
+	return 0;
+}
@@ -0,0 +1,212 @@
+/*
+ * ringbench - one trap per operation versus batched submission.
+ *
+ * Writes NRECS small records to a scratch file, then reads them back
+ * with pread, each way: one system call per record, and through an
+ * ioring, queueing a ring's worth of operations per ioring_enter.
+ * Reports the average cost of one operation and checks what was
+ * read back. The records are small, so the difference is mostly the
+ * cost of the trap.
+ *
+ * Usage: ringbench [records]
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <err.h>
+#include <ioring.h>
+
+#define NRECS		4000
+#define RECSIZE		64
+#define PATH		"ringbench.tmp"
+
+static struct ioring ring;
+static char recs[IORING_ENTRIES][RECSIZE];
+static int nrecs = NRECS;
+
+static
+unsigned long long
+now_ns(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	__time(&secs, &nsecs);
+	return secs * 1000000000ULL + nsecs;
+}
+
+/*
+ * Record N is filled with one byte that depends on N.
+ */
+static
+void
+fillrec(char *buf, int n)
+{
+	memset(buf, 'a' + n % 26, RECSIZE);
+}
+
+static
+void
+checkrec(const char *buf, int n)
+{
+	int i;
+
+	for (i=0; i<RECSIZE; i++) {
+		if (buf[i] != 'a' + n % 26) {
+			errx(1, "record %d: wrong data at byte %d", n, i);
+		}
+	}
+}
+
+static
+int
+openfile(int trunc)
+{
+	int fd;
+
+	fd = open(PATH, O_RDWR | O_CREAT | (trunc ? O_TRUNC : 0), 0664);
+	if (fd < 0) {
+		err(1, "%s", PATH);
+	}
+	return fd;
+}
+
+static
+void
+report(const char *what, unsigned long long start, unsigned long long end)
+{
+	printf("ringbench: %-16s %llu ns per op\n", what,
+	       (end - start) / nrecs);
+}
+
+////////////////////////////////////////////////////////////
+// one trap per operation
+
+static
+void
+plain_write(int fd)
+{
+	char buf[RECSIZE];
+	int i, r;
+
+	for (i=0; i<nrecs; i++) {
+		fillrec(buf, i);
+		r = write(fd, buf, RECSIZE);
+		if (r != RECSIZE) {
+			err(1, "write record %d", i);
+		}
+	}
+}
+
+static
+void
+plain_pread(int fd)
+{
+	char buf[RECSIZE];
+	int i, r;
+
+	for (i=0; i<nrecs; i++) {
+		r = pread(fd, buf, RECSIZE, (off_t)i * RECSIZE);
+		if (r != RECSIZE) {
+			err(1, "pread record %d", i);
+		}
+		checkrec(buf, i);
+	}
+}
+
+////////////////////////////////////////////////////////////
+// batched
+
+/*
+ * Queue one operation per record, a ring at a time, submitting each
+ * ringful with one ioring_enter and checking the completions. Each
+ * record in flight has its own slot in recs[].
+ */
+static
+void
+ring_run(int fd, int op)
+{
+	struct ioring_cqe cqe;
+	char *buf;
+	int next, i, r;
+
+	next = 0;
+	while (next < nrecs) {
+		for (i=0; i<IORING_ENTRIES && next < nrecs; i++, next++) {
+			buf = recs[next % IORING_ENTRIES];
+			if (op == IORING_OP_WRITE) {
+				fillrec(buf, next);
+			}
+			r = ioring_queue(&ring, op, fd, buf, RECSIZE,
+					 (off_t)next * RECSIZE, next);
+			if (r < 0) {
+				errx(1, "ioring_queue: ring full");
+			}
+		}
+		/* the completion ring is empty, so it all goes at once */
+		if (ioring_submit(&ring) != i) {
+			err(1, "ioring_enter");
+		}
+		while (ioring_reap(&ring, &cqe)) {
+			if (cqe.cqe_res != RECSIZE) {
+				errx(1, "record %u: result %d",
+				     cqe.cqe_data, cqe.cqe_res);
+			}
+			if (op == IORING_OP_PREAD) {
+				checkrec(recs[cqe.cqe_data % IORING_ENTRIES],
+					 cqe.cqe_data);
+			}
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////
+
+int
+main(int argc, char *argv[])
+{
+	unsigned long long start, end;
+	int fd;
+
+	if (argc > 1) {
+		nrecs = atoi(argv[1]);
+		if (nrecs <= 0) {
+			errx(1, "Usage: ringbench [records]");
+		}
+	}
+	ioring_init(&ring);
+
+	fd = openfile(1);
+	start = now_ns();
+	plain_write(fd);
+	end = now_ns();
+	report("write", start, end);
+
+	start = now_ns();
+	plain_pread(fd);
+	end = now_ns();
+	report("pread", start, end);
+	close(fd);
+
+	fd = openfile(1);
+	start = now_ns();
+	ring_run(fd, IORING_OP_WRITE);
+	end = now_ns();
+	report("ring write", start, end);
+
+	start = now_ns();
+	ring_run(fd, IORING_OP_PREAD);
+	end = now_ns();
+	report("ring pread", start, end);
+
+	/* and the file should be the same as the first time */
+	plain_pread(fd);
+	close(fd);
+
+	if (remove(PATH) < 0) {
+		warn("remove %s", PATH);
+	}
+	return 0;
+}
@@ -35,14 +35,14 @@
  * This won't do much of anything unless you implement user-level
  * threads.
  *
- * It also makes various assumptions about the thread API. In
- * particular, it believes (1) that you create a thread by calling
- * "threadfork()" and passing the address for execution of the new
- * thread to begin at, (2) that if the parent thread exits any child
- * threads will keep running, and (3) child threads will exit if they
- * return from the function they started in. If any or all of these
- * assumptions are not met by your user-level threads, you will need
- * to patch this test accordingly.
+ * Threads are created with thread_create(), and exit when they
+ * return from the function they started in. Since exiting the
+ * process takes all its threads with it, the parent waits for the
+ * children with thread_join() before returning.
+ *
+ * Afterwards one of the threads tries to execv a file that isn't a
+ * program, which must fail and leave it running as it was, and then
+ * creates threads of its own; they must not be given its stack.
  *
  * This is also a rather basic test and you'll probably want to write
  * some more of your own.
@@ -50,36 +50,59 @@
 
 
 #include <unistd.h>
+#include <string.h>
 #include <stdio.h>
+#include <errno.h>
+#include <err.h>
 
 #define NTHREADS  3
 #define MAX       1<<25
 
+#define NOTELF    "userthreads.tmp"
+#define CANARY    0x5a
+
 /* counter for the loop in the threads : 
    This variable is shared and incremented by each 
    thread during his computation */
 volatile int count = 0;
 
 /* the 2 threads : */
-void ThreadRunner(void);
-void BladeRunner(void);
+int ThreadRunner(void *);
+int BladeRunner(void *);
+int Execer(void *);
+int Idler(void *);
 
 int
 main(int argc, char *argv[])
 {
-    int i;
+    int i, tids[NTHREADS];
 
     (void)argc;
     (void)argv;
 
     for (i=0; i<NTHREADS; i++) {
 	if (i)
-	    threadfork(ThreadRunner);
+	    tids[i] = thread_create(ThreadRunner, NULL);
         else
-	    threadfork(BladeRunner);
+	    tids[i] = thread_create(BladeRunner, NULL);
+	if (tids[i] < 0)
+	    err(1, "thread_create");
+    }
+
+    for (i=0; i<NTHREADS; i++) {
+	if (thread_join(tids[i], NULL) < 0)
+	    err(1, "thread_join");
     }
 
     printf("Parent has left.\n");
+
+    tids[0] = thread_create(Execer, NULL);
+    if (tids[0] < 0)
+	err(1, "thread_create");
+    if (thread_join(tids[0], NULL) < 0)
+	err(1, "thread_join");
+    remove(NOTELF);
+    printf("Failed exec passed.\n");
     return 0;
 }
 
@@ -88,23 +111,76 @@ main(int argc, char *argv[])
    random results.
 */
 
-void
-BladeRunner()
+int
+BladeRunner(void *junk)
 {
+    (void)junk;
     while (count < MAX) {
 	if (count % 500 == 0)
 	    printf("Blade ");
 	count++;
     }
+    return 0;
 }
 
-void
-ThreadRunner()
+int
+ThreadRunner(void *junk)
 {
+    (void)junk;
     while (count < MAX) {
 	if (count % 513 == 0)
 	    printf(" Runner\n");
 	count++;
     }
+    return 0;
 }
     
+
+/* a thread that doesn't do much, to take up a slot */
+int
+Idler(void *junk)
+{
+    (void)junk;
+    return 0;
+}
+
+/*
+ * execv a text file from a thread other than the main one, then
+ * make sure the failed exec left our stack ours: new threads must
+ * not be started on it.
+ */
+int
+Execer(void *junk)
+{
+    char buf[256];
+    char *args[2] = { (char *)NOTELF, NULL };
+    int i, fd, tids[NTHREADS];
+
+    (void)junk;
+    fd = open(NOTELF, O_WRONLY | O_CREAT | O_TRUNC, 0664);
+    if (fd < 0)
+	err(1, "%s", NOTELF);
+    if (write(fd, "not a program\n", 14) != 14)
+	err(1, "%s: write", NOTELF);
+    close(fd);
+
+    memset(buf, CANARY, sizeof(buf));
+    execv(NOTELF, args);
+    if (errno != ENOEXEC)
+	warn("execv %s: expected ENOEXEC", NOTELF);
+
+    for (i=0; i<NTHREADS; i++) {
+	tids[i] = thread_create(Idler, NULL);
+	if (tids[i] < 0)
+	    err(1, "thread_create after failed exec");
+    }
+    for (i=0; i<NTHREADS; i++) {
+	if (thread_join(tids[i], NULL) < 0)
+	    err(1, "thread_join after failed exec");
+    }
+    for (i=0; i<(int)sizeof(buf); i++) {
+	if (buf[i] != CANARY)
+	    errx(1, "stack clobbered after failed exec");
+    }
+    return 0;
+}